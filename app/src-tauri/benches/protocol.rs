@@ -0,0 +1,145 @@
+//! Benchmarks for the per-frame hot path: packet encoding, checksums,
+//! Kelvin conversions, status parsing, and the read loop's framing on
+//! synthetic byte streams (clean, noisy and fragmented).
+//!
+//! Run from `app/src-tauri` with `cargo bench`; Criterion keeps the last run
+//! under `target/criterion` and reports the change against it.
+use std::hint::black_box;
+
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use neewer_usb_control_lib::framing::Framer;
+use neewer_usb_control_lib::protocol;
+
+/// Frames per synthetic stream.
+const FRAMES: usize = 256;
+
+/// Small deterministic generator so every run sees the same streams.
+struct Lcg(u32);
+
+impl Lcg {
+    fn next(&mut self) -> u8 {
+        self.0 = self.0.wrapping_mul(1_664_525).wrapping_add(1_013_904_223);
+        (self.0 >> 24) as u8
+    }
+}
+
+/// Back-to-back status packets across the whole brightness/Kelvin range.
+fn clean_stream() -> Vec<u8> {
+    (0..FRAMES)
+        .flat_map(|i| {
+            let kelvin = protocol::TEMP_MIN_K
+                + (i as u32 * 37) % (protocol::TEMP_MAX_K - protocol::TEMP_MIN_K);
+            protocol::cct_command((i % 101) as u8, kelvin)
+                .as_bytes()
+                .to_vec()
+        })
+        .collect()
+}
+
+/// The clean stream with line noise between packets: random bytes, stray
+/// start bytes and every eighth packet's checksum corrupted.
+fn noisy_stream() -> Vec<u8> {
+    let mut rng = Lcg(0x5EED);
+    let mut out = Vec::new();
+    for (i, frame) in clean_stream().chunks(8).enumerate() {
+        for _ in 0..rng.next() % 6 {
+            out.push(rng.next());
+        }
+        if i % 16 == 0 {
+            out.push(0x3A);
+        }
+        out.extend_from_slice(frame);
+        if i % 8 == 0 {
+            let last = out.len() - 1;
+            out[last] ^= 0x55;
+        }
+    }
+    out
+}
+
+/// Clean stream split into reads of 1 to 7 bytes, as a slow USB bridge
+/// delivers it.
+fn fragmented_reads() -> Vec<Vec<u8>> {
+    let stream = clean_stream();
+    let mut rng = Lcg(0xF7A6);
+    let mut reads = Vec::new();
+    let mut rest = &stream[..];
+    while !rest.is_empty() {
+        let n = (1 + rng.next() as usize % 7).min(rest.len());
+        reads.push(rest[..n].to_vec());
+        rest = &rest[n..];
+    }
+    reads
+}
+
+/// What `read_loop` does with each read: frame it and parse every packet.
+fn frame_and_parse(framer: &mut Framer, data: &[u8]) -> u32 {
+    let mut parsed = 0;
+    framer.feed(data, |frame| {
+        if let Some(status) = protocol::parse_status(black_box(frame)) {
+            black_box(status);
+            parsed += 1;
+        }
+    });
+    parsed
+}
+
+fn encoding(c: &mut Criterion) {
+    let frame = protocol::cct_command(64, 4950);
+    c.bench_function("checksum", |b| {
+        b.iter(|| protocol::checksum(black_box(&frame[..6])))
+    });
+    c.bench_function("cct_command", |b| {
+        b.iter(|| protocol::cct_command(black_box(64), black_box(4950)))
+    });
+    c.bench_function("parse_status", |b| {
+        b.iter(|| protocol::parse_status(black_box(&frame[..])))
+    });
+}
+
+fn conversions(c: &mut Criterion) {
+    c.bench_function("kelvin_to_byte", |b| {
+        b.iter(|| {
+            (protocol::TEMP_MIN_K..=protocol::TEMP_MAX_K)
+                .step_by(50)
+                .map(|k| protocol::kelvin_to_byte(black_box(k)) as u32)
+                .sum::<u32>()
+        })
+    });
+    c.bench_function("byte_to_kelvin", |b| {
+        b.iter(|| {
+            (0..=protocol::TEMP_STEPS)
+                .map(|t| protocol::byte_to_kelvin(black_box(t as u8)))
+                .sum::<u32>()
+        })
+    });
+}
+
+fn framing(c: &mut Criterion) {
+    let clean = clean_stream();
+    let noisy = noisy_stream();
+    let fragmented = fragmented_reads();
+
+    let mut group = c.benchmark_group("framing");
+    group.throughput(Throughput::Bytes(clean.len() as u64));
+    group.bench_function("clean", |b| {
+        b.iter(|| frame_and_parse(&mut Framer::new(), black_box(&clean)))
+    });
+    group.bench_function("fragmented", |b| {
+        b.iter(|| {
+            let mut framer = Framer::new();
+            fragmented
+                .iter()
+                .map(|read| frame_and_parse(&mut framer, black_box(read)))
+                .sum::<u32>()
+        })
+    });
+    group.throughput(Throughput::Bytes(noisy.len() as u64));
+    group.bench_function("noisy", |b| {
+        b.iter(|| frame_and_parse(&mut Framer::new(), black_box(&noisy)))
+    });
+    group.finish();
+}
+
+criterion_group!(benches, encoding, conversions, framing);
+criterion_main!(benches);
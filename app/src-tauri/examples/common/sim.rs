@@ -0,0 +1,154 @@
+//! A simulated PL81-Pro on the master side of a pty, shared by the
+//! examples: it frames what it receives, echoes every valid CCT command and
+//! keeps its temperature clamped at 0x12 (7000K), as the calibration found.
+//! Echoes can be delayed, jittered and corrupted.
+use std::collections::VecDeque;
+use std::io::{Read, Write};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+use neewer_usb_control_lib::framing::Framer;
+use neewer_usb_control_lib::protocol::{self, TEMP_STEPS};
+use serialport::{SerialPort, TTYPort};
+
+#[derive(Debug, Clone, Copy)]
+pub struct Config {
+    /// Delay from receiving a command to echoing it.
+    pub latency: Duration,
+    /// Up to this much extra delay, uniformly.
+    pub jitter: Duration,
+    /// Chance of an echo having one byte damaged.
+    pub corrupt: f64,
+}
+
+/// Small xorshift generator, so runs are repeatable per seed.
+pub struct Rng(u64);
+
+impl Rng {
+    pub fn new(seed: u64) -> Self {
+        Self(seed.wrapping_mul(0x9E37_79B9_7F4A_7C15) | 1)
+    }
+
+    pub fn next(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0
+    }
+
+    /// Uniform in [0, 1).
+    pub fn unit(&mut self) -> f64 {
+        (self.next() >> 11) as f64 / (1u64 << 53) as f64
+    }
+}
+
+#[derive(Default)]
+pub struct Counters {
+    pub commands: AtomicU64,
+    pub corrupted: AtomicU64,
+}
+
+pub struct Light {
+    pub path: String,
+    pub counters: Arc<Counters>,
+    /// Brightness and temperature byte the light is showing.
+    pub state: Arc<Mutex<Option<(u8, u8)>>>,
+    running: Arc<AtomicBool>,
+    thread: Option<JoinHandle<()>>,
+    /// Held so the master doesn't read EIO while no one else has the
+    /// slave open.
+    _slave: TTYPort,
+}
+
+impl Light {
+    /// Open a pty and serve it from a thread. `path` is the slave side,
+    /// for `SerialManager::connect`.
+    pub fn spawn(config: Config, seed: u64) -> Result<Self, String> {
+        let (mut master, mut slave) =
+            TTYPort::pair().map_err(|e| format!("Failed to open a pty: {e}"))?;
+        let path = slave.name().ok_or("pty has no name")?;
+        // Let the manager open the slave side alongside ours.
+        slave
+            .set_exclusive(false)
+            .map_err(|e| format!("Failed to share {path}: {e}"))?;
+        master
+            .set_timeout(Duration::from_millis(1))
+            .map_err(|e| format!("Failed to set pty timeout: {e}"))?;
+
+        let counters = Arc::new(Counters::default());
+        let state = Arc::new(Mutex::new(None));
+        let running = Arc::new(AtomicBool::new(true));
+        let thread = {
+            let (counters, state, running) = (counters.clone(), state.clone(), running.clone());
+            std::thread::spawn(move || {
+                serve(master, config, Rng::new(seed), &counters, &state, &running)
+            })
+        };
+        Ok(Self {
+            path,
+            counters,
+            state,
+            running,
+            thread: Some(thread),
+            _slave: slave,
+        })
+    }
+}
+
+impl Drop for Light {
+    fn drop(&mut self) {
+        self.running.store(false, Ordering::Relaxed);
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+fn serve(
+    mut port: TTYPort,
+    config: Config,
+    mut rng: Rng,
+    counters: &Counters,
+    state: &Mutex<Option<(u8, u8)>>,
+    running: &AtomicBool,
+) {
+    let mut framer = Framer::new();
+    let mut buf = [0u8; 256];
+    // Echoes waiting for their send time, in order: the line is FIFO.
+    let mut echoes: VecDeque<(Instant, [u8; 8])> = VecDeque::new();
+    let mut last_due = Instant::now();
+
+    while running.load(Ordering::Relaxed) {
+        match port.read(&mut buf) {
+            Ok(n) => framer.feed(&buf[..n], |frame| {
+                let (Some((bri, temp_byte)), Ok(echo)) =
+                    (protocol::parse_status(frame), <[u8; 8]>::try_from(frame))
+                else {
+                    return;
+                };
+                counters.commands.fetch_add(1, Ordering::Relaxed);
+                *state.lock().unwrap() = Some((bri, temp_byte.min(TEMP_STEPS as u8)));
+                let jitter = config.jitter.mul_f64(rng.unit());
+                last_due = last_due.max(Instant::now() + config.latency + jitter);
+                echoes.push_back((last_due, echo));
+            }),
+            Err(e) if e.kind() == std::io::ErrorKind::TimedOut => {}
+            Err(_) => return,
+        }
+
+        let now = Instant::now();
+        while echoes.front().is_some_and(|(due, _)| *due <= now) {
+            let (_, mut echo) = echoes.pop_front().unwrap();
+            if rng.unit() < config.corrupt {
+                let at = rng.next() as usize % echo.len();
+                echo[at] ^= 1 << (rng.next() % 8);
+                counters.corrupted.fetch_add(1, Ordering::Relaxed);
+            }
+            if port.write_all(&echo).is_err() {
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,28 @@
+//! Compile a cue file into a binary timeline for `play_timeline`.
+//!
+//! Run from `app/src-tauri`:
+//! `cargo run --example compile_timeline -- show.cue show.nwtl`
+use std::process::ExitCode;
+
+use neewer_usb_control_lib::timeline;
+
+fn main() -> ExitCode {
+    let args: Vec<String> = std::env::args().skip(1).collect();
+    let [input, output] = &args[..] else {
+        eprintln!("usage: compile_timeline <cue file> <output.nwtl>");
+        return ExitCode::FAILURE;
+    };
+    let result = std::fs::read_to_string(input)
+        .map_err(|e| format!("Failed to read {input}: {e}"))
+        .and_then(|source| timeline::compile(&source).map_err(|e| format!("{input}: {e}")))
+        .and_then(|bytes| {
+            std::fs::write(output, &bytes).map_err(|e| format!("Failed to write {output}: {e}"))
+        });
+    match result {
+        Ok(()) => ExitCode::SUCCESS,
+        Err(e) => {
+            eprintln!("{e}");
+            ExitCode::FAILURE
+        }
+    }
+}
@@ -0,0 +1,305 @@
+//! Replay a serial capture (`NEEWER_CAPTURE=<file>`) offline.
+//!
+//! By default each light's received bytes go back through the framer: the
+//! report gives frames, resyncs, echo round-trips and the longest gaps
+//! between writes, as the capture timed them, then the parser's throughput
+//! on the captured bytes. With `--device`, each light's captured writes are
+//! posted again at their captured times, through a `SerialManager`, to a
+//! simulated light (macOS/Linux), to see how today's writer keeps up.
+//!
+//! Run from `app/src-tauri`:
+//! `cargo run --release --example replay -- trace.nwcp [--device] [--latency-ms L] [--jitter-ms J]`
+use std::collections::{BTreeMap, VecDeque};
+use std::path::Path;
+use std::process::ExitCode;
+use std::time::{Duration, Instant};
+
+use neewer_usb_control_lib::capture::{Kind, Recording};
+use neewer_usb_control_lib::framing::Framer;
+
+#[cfg(unix)]
+#[path = "common/sim.rs"]
+mod sim;
+
+/// How long the throughput measurement runs for.
+const BENCH_TIME: Duration = Duration::from_millis(500);
+/// Gaps listed per light.
+const LONGEST_GAPS: usize = 5;
+
+/// One light's traffic, times in ns from the start of the capture.
+#[derive(Default)]
+struct Stream {
+    /// Empty if the ring wrapped over its `Open` record.
+    id: String,
+    tx: Vec<(u64, Vec<u8>)>,
+    rx: Vec<(u64, Vec<u8>)>,
+    dropped: u64,
+}
+
+fn streams(recording: &Recording) -> BTreeMap<u16, Stream> {
+    let mut streams: BTreeMap<u16, Stream> = BTreeMap::new();
+    for record in &recording.records {
+        let stream = streams.entry(record.light).or_default();
+        let bytes = record.bytes();
+        match record.kind {
+            Kind::Open => stream.id = String::from_utf8_lossy(bytes).into_owned(),
+            Kind::Tx => stream.tx.push((record.t_ns, bytes.to_vec())),
+            // Records split from one read share its timestamp.
+            Kind::Rx => match stream.rx.last_mut() {
+                Some((t, chunk)) if *t == record.t_ns => chunk.extend_from_slice(bytes),
+                _ => stream.rx.push((record.t_ns, bytes.to_vec())),
+            },
+            Kind::Dropped => {
+                stream.dropped += u32::from_le_bytes(bytes.try_into().unwrap_or_default()) as u64
+            }
+        }
+    }
+    streams
+}
+
+fn ms(ns: u64) -> f64 {
+    ns as f64 / 1e6
+}
+
+/// `q` (0..=1) of `sorted`, or 0 if empty.
+fn quantile(sorted: &[u64], q: f64) -> u64 {
+    match sorted.len() {
+        0 => 0,
+        n => sorted[((n - 1) as f64 * q).round() as usize],
+    }
+}
+
+fn analyze(light: u16, stream: &Stream) {
+    let mut framer = Framer::new();
+    // Written frames not yet echoed, oldest first.
+    let mut unechoed: VecDeque<&(u64, Vec<u8>)> = VecDeque::new();
+    let mut tx = stream.tx.iter().peekable();
+    let mut rtts = Vec::new();
+    let mut reports = 0;
+    for (t, chunk) in &stream.rx {
+        while let Some(sent) = tx.next_if(|(sent_at, _)| sent_at <= t) {
+            unechoed.push_back(sent);
+        }
+        framer.feed(chunk, |frame| {
+            match unechoed.iter().position(|(_, sent)| sent == frame) {
+                // Anything written before it was superseded or lost.
+                Some(at) => {
+                    rtts.push(t - unechoed[at].0);
+                    unechoed.drain(..=at);
+                }
+                None => reports += 1,
+            }
+        });
+    }
+    rtts.sort_unstable();
+
+    let mut gaps: Vec<(u64, u64)> = stream
+        .tx
+        .windows(2)
+        .map(|w| (w[1].0 - w[0].0, w[1].0))
+        .collect();
+    gaps.sort_unstable_by(|a, b| b.cmp(a));
+    gaps.truncate(LONGEST_GAPS);
+
+    println!(
+        "light {light} ({}): {} writes, {} echoes, {reports} reports, {} resyncs, \
+         {} bytes skipped, {} records dropped",
+        if stream.id.is_empty() {
+            "?"
+        } else {
+            &stream.id
+        },
+        stream.tx.len(),
+        rtts.len(),
+        framer.resyncs(),
+        framer.skipped(),
+        stream.dropped
+    );
+    println!(
+        "  echo rtt    {:.2} ms p50, {:.2} ms p99, {:.2} ms max",
+        ms(quantile(&rtts, 0.5)),
+        ms(quantile(&rtts, 0.99)),
+        ms(rtts.last().copied().unwrap_or_default())
+    );
+    let gaps: Vec<String> = gaps
+        .iter()
+        .map(|(gap, at)| format!("{:.1} ms at {:.3} s", ms(*gap), *at as f64 / 1e9))
+        .collect();
+    println!("  write gaps  {}", gaps.join(", "));
+}
+
+/// Feed every captured read through a fresh framer, over and over.
+fn bench_parser(streams: &BTreeMap<u16, Stream>) {
+    let chunks: Vec<&[u8]> = streams
+        .values()
+        .flat_map(|s| s.rx.iter().map(|(_, c)| c.as_slice()))
+        .collect();
+    let bytes: usize = chunks.iter().map(|c| c.len()).sum();
+    if bytes == 0 {
+        println!("parser      no received bytes to measure");
+        return;
+    }
+    let mut passes = 0u64;
+    let mut frames = 0u64;
+    let start = Instant::now();
+    while start.elapsed() < BENCH_TIME {
+        let mut framer = Framer::new();
+        for chunk in &chunks {
+            framer.feed(std::hint::black_box(chunk), |_| frames += 1);
+        }
+        passes += 1;
+    }
+    let elapsed = start.elapsed().as_secs_f64();
+    println!(
+        "parser      {:.1} MB/s, {:.2} M frames/s ({bytes} bytes x {passes})",
+        (bytes as u64 * passes) as f64 / elapsed / 1e6,
+        frames as f64 / elapsed / 1e6
+    );
+}
+
+#[cfg(unix)]
+fn replay_device(streams: &BTreeMap<u16, Stream>, config: sim::Config) -> Result<(), String> {
+    use std::sync::atomic::Ordering;
+
+    use neewer_usb_control_lib::protocol;
+    use neewer_usb_control_lib::serial::{LightStatus, LinkEvents, Priority, SerialManager};
+
+    struct Quiet;
+
+    impl LinkEvents for Quiet {
+        fn status(&self, _status: LightStatus) {}
+        fn disconnected(&self, _id: &str) {}
+    }
+
+    // Each light with its simulation and the last state posted to it.
+    let mut lights = BTreeMap::new();
+    for (&light, stream) in streams.iter().filter(|(_, s)| !s.tx.is_empty()) {
+        let sim = sim::Light::spawn(config, light as u64 + 1)?;
+        let manager = SerialManager::new(stream.id.clone());
+        tauri::async_runtime::block_on(manager.connect(&sim.path, Quiet))?;
+        lights.insert(light, (manager, sim, None));
+    }
+
+    // Every light's writes, merged in time order. They go in as background
+    // traffic, so the pacer decides the spacing afresh.
+    let mut writes: Vec<(u64, u16, &[u8])> = streams
+        .iter()
+        .flat_map(|(&light, s)| s.tx.iter().map(move |(t, b)| (*t, light, b.as_slice())))
+        .collect();
+    writes.sort_by_key(|w| w.0);
+    let first = writes.first().map_or(0, |w| w.0);
+    let start = Instant::now();
+    for (t, light, bytes) in writes {
+        let Some((bri, temp_byte)) = protocol::parse_status(bytes) else {
+            continue;
+        };
+        let due = start + Duration::from_nanos(t - first);
+        std::thread::sleep(due.saturating_duration_since(Instant::now()));
+        let (manager, _, last) = lights.get_mut(&light).unwrap();
+        let cct = protocol::Cct::new(bri, protocol::byte_to_kelvin(temp_byte));
+        if manager.submit(cct, Priority::Background).is_ok() {
+            *last = Some((bri, temp_byte.min(protocol::TEMP_STEPS as u8)));
+        }
+    }
+    // Let the last frames settle: resends give up after a few timeouts.
+    std::thread::sleep(Duration::from_secs(2));
+
+    for (light, (manager, sim, last)) in &lights {
+        let c = manager.counters();
+        let settled = *sim.state.lock().unwrap() == *last;
+        println!(
+            "device {light} ({}): {} received, {} acked, {} lost, {} resends, {} resyncs, \
+             rtt {:.2} ms, send interval {:.2} ms, final state {}",
+            manager.id(),
+            sim.counters.commands.load(Ordering::Relaxed),
+            c.acked,
+            c.lost,
+            c.retries,
+            c.resyncs,
+            c.rtt_us.unwrap_or_default() as f64 / 1000.0,
+            c.send_interval_us as f64 / 1000.0,
+            if settled { "ok" } else { "wrong" }
+        );
+        manager.disconnect();
+    }
+    Ok(())
+}
+
+fn main() -> ExitCode {
+    let args: Vec<String> = std::env::args().skip(1).collect();
+    let Some(path) = args.first() else {
+        eprintln!("usage: replay <capture> [--device] [--latency-ms L] [--jitter-ms J]");
+        return ExitCode::FAILURE;
+    };
+    let mut device = false;
+    let mut latency_ms = 2.0;
+    let mut jitter_ms = 1.0;
+    let mut flags = args[1..].iter();
+    while let Some(flag) = flags.next() {
+        let mut value = |v: &mut f64| match flags.next().and_then(|s| s.parse().ok()) {
+            Some(number) => {
+                *v = number;
+                true
+            }
+            None => false,
+        };
+        let ok = match flag.as_str() {
+            "--device" => {
+                device = true;
+                true
+            }
+            "--latency-ms" => value(&mut latency_ms),
+            "--jitter-ms" => value(&mut jitter_ms),
+            _ => false,
+        };
+        if !ok {
+            eprintln!("bad argument: {flag}");
+            return ExitCode::FAILURE;
+        }
+    }
+
+    let recording = match Recording::open(Path::new(path)) {
+        Ok(recording) => recording,
+        Err(e) => {
+            eprintln!("{e}");
+            return ExitCode::FAILURE;
+        }
+    };
+    let span = recording.records.last().map_or(0, |r| r.t_ns)
+        - recording.records.first().map_or(0, |r| r.t_ns);
+    println!(
+        "{} records over {:.3} s, {} overwritten by the ring",
+        recording.records.len(),
+        span as f64 / 1e9,
+        recording.overwritten
+    );
+    let streams = streams(&recording);
+
+    if !device {
+        for (light, stream) in &streams {
+            analyze(*light, stream);
+        }
+        bench_parser(&streams);
+        return ExitCode::SUCCESS;
+    }
+
+    #[cfg(unix)]
+    {
+        let config = sim::Config {
+            latency: Duration::from_secs_f64(latency_ms / 1000.0),
+            jitter: Duration::from_secs_f64(jitter_ms / 1000.0),
+            corrupt: 0.0,
+        };
+        if let Err(e) = replay_device(&streams, config) {
+            eprintln!("{e}");
+            return ExitCode::FAILURE;
+        }
+        ExitCode::SUCCESS
+    }
+    #[cfg(not(unix))]
+    {
+        let _ = (latency_ms, jitter_ms);
+        eprintln!("--device needs ptys; run it on macOS or Linux");
+        ExitCode::FAILURE
+    }
+}
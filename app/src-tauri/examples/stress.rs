@@ -0,0 +1,208 @@
+//! Load test the serial stack against simulated lights, no hardware needed.
+//!
+//! Each virtual light sits on the master side of a pty and behaves like a
+//! PL81-Pro: it frames what it receives, echoes every valid CCT command and
+//! keeps its temperature clamped at 0x12 (7000K), as the calibration found.
+//! Echoes can be delayed, jittered and corrupted. A `SerialManager` per
+//! light drives the slave side through the real writer, pacer and framer.
+//!
+//! Run from `app/src-tauri`:
+//! `cargo run --release --example stress -- --lights 32 --seconds 10 --corrupt 0.01`
+//!
+//! With `NEEWER_CAPTURE=<file>` set, the run's traffic is captured for the
+//! `replay` example.
+#[cfg(unix)]
+#[path = "common/sim.rs"]
+mod sim;
+
+#[cfg(unix)]
+fn main() -> std::process::ExitCode {
+    use std::process::ExitCode;
+    use std::sync::atomic::{AtomicU64, Ordering};
+    use std::sync::Arc;
+    use std::time::{Duration, Instant};
+
+    use neewer_usb_control_lib::serial::{LightStatus, LinkEvents, Priority, SerialManager};
+    use neewer_usb_control_lib::{capture, protocol};
+
+    #[derive(Clone, Default)]
+    struct Events(Arc<(AtomicU64, AtomicU64)>);
+
+    impl LinkEvents for Events {
+        fn status(&self, _status: LightStatus) {
+            self.0 .0.fetch_add(1, Ordering::Relaxed);
+        }
+
+        fn disconnected(&self, _id: &str) {
+            self.0 .1.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+
+    let mut lights = 32usize;
+    let mut seconds = 5.0;
+    let mut window = None;
+    let mut config = sim::Config {
+        latency: Duration::from_millis(2),
+        jitter: Duration::from_millis(1),
+        corrupt: 0.0,
+    };
+    let args: Vec<String> = std::env::args().skip(1).collect();
+    for pair in args.chunks(2) {
+        let [flag, value] = pair else {
+            eprintln!("{} needs a value", pair[0]);
+            return ExitCode::FAILURE;
+        };
+        let Ok(number) = value.parse::<f64>() else {
+            eprintln!("bad value for {flag}: {value}");
+            return ExitCode::FAILURE;
+        };
+        match flag.as_str() {
+            "--lights" => lights = number as usize,
+            "--seconds" => seconds = number,
+            "--window" => window = Some(number as usize),
+            "--latency-ms" => config.latency = Duration::from_secs_f64(number / 1000.0),
+            "--jitter-ms" => config.jitter = Duration::from_secs_f64(number / 1000.0),
+            "--corrupt" => config.corrupt = number,
+            _ => {
+                eprintln!(
+                    "usage: stress [--lights N] [--seconds S] [--window W] \
+                     [--latency-ms L] [--jitter-ms J] [--corrupt P]"
+                );
+                return ExitCode::FAILURE;
+            }
+        }
+    }
+
+    if let Err(e) = capture::start_from_env() {
+        eprintln!("{e}");
+        return ExitCode::FAILURE;
+    }
+    let events = Events::default();
+    let mut sims = Vec::new();
+    let mut managers = Vec::new();
+    for i in 0..lights {
+        let light = match sim::Light::spawn(config, i as u64 + 1) {
+            Ok(light) => light,
+            Err(e) => {
+                eprintln!("{e}");
+                return ExitCode::FAILURE;
+            }
+        };
+        let manager = SerialManager::new(format!("sim{i}"));
+        if let Some(window) = window {
+            manager.set_window(window);
+        }
+        let connected =
+            tauri::async_runtime::block_on(manager.connect(&light.path, events.clone()));
+        if let Err(e) = connected {
+            eprintln!("{e}");
+            return ExitCode::FAILURE;
+        }
+        sims.push(light);
+        managers.push(manager);
+    }
+
+    // Post as fast as a dragged slider would, and faster: every light, every
+    // millisecond, walking brightness and the full temperature byte range.
+    let mut rng = sim::Rng::new(0);
+    let mut last = vec![None; lights];
+    let mut posts = 0u64;
+    let start = Instant::now();
+    let run = Duration::from_secs_f64(seconds);
+    while start.elapsed() < run {
+        for (manager, last) in managers.iter().zip(&mut last) {
+            let bri = (rng.next() % 101) as u8;
+            let temp_byte = (rng.next() % 0x40) as u8;
+            if manager
+                .submit(
+                    protocol::Cct::new(bri, protocol::byte_to_kelvin(temp_byte)),
+                    Priority::Background,
+                )
+                .is_ok()
+            {
+                *last = Some((bri, temp_byte.min(protocol::TEMP_STEPS as u8)));
+                posts += 1;
+            }
+        }
+        std::thread::sleep(Duration::from_millis(1));
+    }
+    let elapsed = start.elapsed().as_secs_f64();
+    // Let the last frames settle: resends give up after a few timeouts.
+    std::thread::sleep(Duration::from_secs(2));
+
+    let mut acked = 0;
+    let mut lost = 0;
+    let mut retries = 0;
+    let mut resyncs = 0;
+    let mut rtts = Vec::new();
+    let mut intervals = Vec::new();
+    for manager in &managers {
+        let c = manager.counters();
+        acked += c.acked;
+        lost += c.lost;
+        retries += c.retries;
+        resyncs += c.resyncs;
+        rtts.extend(c.rtt_us);
+        intervals.push(c.send_interval_us);
+    }
+    let received: u64 = sims
+        .iter()
+        .map(|s| s.counters.commands.load(Ordering::Relaxed))
+        .sum();
+    let corrupted: u64 = sims
+        .iter()
+        .map(|s| s.counters.corrupted.load(Ordering::Relaxed))
+        .sum();
+    let stale = sims
+        .iter()
+        .zip(&last)
+        .filter(|(sim, last)| *sim.state.lock().unwrap() != **last)
+        .count();
+    let mean = |v: &[u64]| v.iter().sum::<u64>() as f64 / v.len().max(1) as f64;
+
+    println!("lights            {lights}");
+    println!(
+        "posts             {posts} ({:.0}/s)",
+        posts as f64 / elapsed
+    );
+    println!(
+        "commands received {received} ({:.0}/s, {:.0}/s per light)",
+        received as f64 / elapsed,
+        received as f64 / elapsed / lights.max(1) as f64
+    );
+    println!(
+        "echoes acked      {acked} ({:.0}/s)",
+        acked as f64 / elapsed
+    );
+    println!(
+        "lost              {lost} ({:.2}% of sent), {retries} resends",
+        100.0 * lost as f64 / (acked + lost).max(1) as f64
+    );
+    println!("corrupted echoes  {corrupted}, host resyncs {resyncs}");
+    println!(
+        "echo rtt          {:.0} us mean, send interval {:.0} us mean",
+        mean(&rtts),
+        mean(&intervals)
+    );
+    println!(
+        "status events     {}, disconnects {}",
+        events.0 .0.load(Ordering::Relaxed),
+        events.0 .1.load(Ordering::Relaxed)
+    );
+    println!("final state wrong {stale} of {lights}");
+
+    for manager in &managers {
+        manager.disconnect();
+    }
+    capture::stop();
+    if stale == 0 {
+        ExitCode::SUCCESS
+    } else {
+        ExitCode::FAILURE
+    }
+}
+
+#[cfg(not(unix))]
+fn main() {
+    eprintln!("stress needs ptys; run it on macOS or Linux");
+}
@@ -0,0 +1,451 @@
+/// Opt-in capture of serial traffic, for replaying stutter offline.
+///
+/// Every frame written and every chunk read, malformed bytes included, is
+/// recorded with a monotonic timestamp. Each connection's writer and reader
+/// task own one single-producer ring apiece: recording is a clock read and a
+/// copy into a preallocated slot, and a full ring drops the record rather
+/// than wait. A background thread drains the rings into a fixed-size,
+/// memory-mapped ring file that wraps around to keep the latest traffic.
+/// The file is updated in place, so it outlives a crash of the app.
+///
+/// Layout (little-endian):
+///
+/// ```text
+/// header  "NWCP" | version u16 | record_len u16 | capacity u32 | reserved u32
+///         | written u64 | started_unix_us u64
+/// record  t_ns u64 | light u16 | kind u8 | len u8 | data [u8; 20]
+/// ```
+///
+/// `written` counts every record stored; record n is in slot n % capacity.
+/// A read longer than one record spans several with the same timestamp, and
+/// each light starts with an `Open` record carrying the end of its id.
+///
+/// Off unless `$NEEWER_CAPTURE` names the file. The `replay` example reads it.
+use std::cell::UnsafeCell;
+use std::fs::{self, OpenOptions};
+use std::path::Path;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, OnceLock};
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
+
+use memmap2::MmapMut;
+
+pub const MAGIC: &[u8; 4] = b"NWCP";
+pub const VERSION: u16 = 1;
+const HEADER_LEN: usize = 32;
+const WRITTEN_AT: usize = 16;
+pub const RECORD_LEN: usize = 32;
+/// Bytes of traffic one record carries.
+pub const RECORD_DATA: usize = RECORD_LEN - 12;
+/// 32 MiB of file: minutes of a busy fleet.
+const DEFAULT_RECORDS: usize = 1 << 20;
+/// Per task. A power of two, so the ring indices can wrap.
+const RING_SLOTS: usize = 4096;
+const DRAIN_INTERVAL: Duration = Duration::from_millis(10);
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Kind {
+    /// A light's first record; the data is the end of its id.
+    Open,
+    /// Bytes written to the port.
+    Tx,
+    /// Bytes read from the port, before framing.
+    Rx,
+    /// The data is a u32 count of this light's records lost to a full ring.
+    Dropped,
+}
+
+impl Kind {
+    fn from_u8(b: u8) -> Option<Self> {
+        [Kind::Open, Kind::Tx, Kind::Rx, Kind::Dropped]
+            .get(b as usize)
+            .copied()
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Record {
+    /// Since the capture started.
+    pub t_ns: u64,
+    /// Numbered in connection order.
+    pub light: u16,
+    pub kind: Kind,
+    len: u8,
+    data: [u8; RECORD_DATA],
+}
+
+impl Record {
+    /// `bytes` past `RECORD_DATA` are cut off.
+    fn new(t_ns: u64, light: u16, kind: Kind, bytes: &[u8]) -> Self {
+        let len = bytes.len().min(RECORD_DATA);
+        let mut data = [0; RECORD_DATA];
+        data[..len].copy_from_slice(&bytes[..len]);
+        Self {
+            t_ns,
+            light,
+            kind,
+            len: len as u8,
+            data,
+        }
+    }
+
+    pub fn bytes(&self) -> &[u8] {
+        &self.data[..self.len as usize]
+    }
+
+    fn read(b: &[u8]) -> Option<Self> {
+        let len = b[11];
+        if len as usize > RECORD_DATA {
+            return None;
+        }
+        Some(Self {
+            t_ns: u64::from_le_bytes(b[..8].try_into().unwrap()),
+            light: u16::from_le_bytes([b[8], b[9]]),
+            kind: Kind::from_u8(b[10])?,
+            len,
+            data: b[12..RECORD_LEN].try_into().unwrap(),
+        })
+    }
+
+    fn write(&self, out: &mut [u8]) {
+        out[..8].copy_from_slice(&self.t_ns.to_le_bytes());
+        out[8..10].copy_from_slice(&self.light.to_le_bytes());
+        out[10] = self.kind as u8;
+        out[11] = self.len;
+        out[12..RECORD_LEN].copy_from_slice(&self.data);
+    }
+}
+
+/// Single-producer, single-consumer queue of records from one task.
+struct Ring {
+    light: u16,
+    slots: Box<[UnsafeCell<Record>]>,
+    /// Next slot to fill; stored only by the producer.
+    head: AtomicUsize,
+    /// Next slot to drain; stored only by the consumer.
+    tail: AtomicUsize,
+    dropped: AtomicU64,
+}
+
+// The producer only writes slots the consumer has released through `tail`,
+// and the consumer only reads slots the producer has published through
+// `head`. There is one of each: `Tap` is the producer and isn't `Clone`,
+// and the rings are drained under the writer's lock.
+unsafe impl Sync for Ring {}
+
+impl Ring {
+    fn new(light: u16) -> Self {
+        let empty = Record::new(0, light, Kind::Open, &[]);
+        Self {
+            light,
+            slots: (0..RING_SLOTS).map(|_| UnsafeCell::new(empty)).collect(),
+            head: AtomicUsize::new(0),
+            tail: AtomicUsize::new(0),
+            dropped: AtomicU64::new(0),
+        }
+    }
+
+    fn push(&self, record: Record) {
+        let head = self.head.load(Ordering::Relaxed);
+        if head.wrapping_sub(self.tail.load(Ordering::Acquire)) == RING_SLOTS {
+            self.dropped.fetch_add(1, Ordering::Relaxed);
+            return;
+        }
+        unsafe { *self.slots[head % RING_SLOTS].get() = record };
+        self.head.store(head.wrapping_add(1), Ordering::Release);
+    }
+
+    fn drain(&self, mut f: impl FnMut(&Record)) {
+        let head = self.head.load(Ordering::Acquire);
+        let mut at = self.tail.load(Ordering::Relaxed);
+        while at != head {
+            f(unsafe { &*self.slots[at % RING_SLOTS].get() });
+            at = at.wrapping_add(1);
+        }
+        self.tail.store(head, Ordering::Release);
+    }
+}
+
+/// The recording end of one ring, owned by a writer or reader task.
+pub struct Tap {
+    ring: Arc<Ring>,
+    kind: Kind,
+    start: Instant,
+}
+
+impl Tap {
+    pub fn record(&mut self, bytes: &[u8]) {
+        let t_ns = self.start.elapsed().as_nanos() as u64;
+        for chunk in bytes.chunks(RECORD_DATA) {
+            self.ring
+                .push(Record::new(t_ns, self.ring.light, self.kind, chunk));
+        }
+    }
+}
+
+/// The ring file and the task rings feeding it.
+struct Writer<B = MmapMut> {
+    map: B,
+    capacity: u64,
+    written: u64,
+    /// Each ring with how many of its drops have been recorded.
+    rings: Vec<(Arc<Ring>, u64)>,
+    lights: u16,
+    start: Instant,
+}
+
+impl<B: AsMut<[u8]>> Writer<B> {
+    /// Write the header over `map`, which must hold `capacity` records.
+    fn new(mut map: B, capacity: usize, start: Instant) -> Self {
+        let started_unix_us = SystemTime::now()
+            .duration_since(UNIX_EPOCH)
+            .unwrap_or_default()
+            .as_micros() as u64;
+        let header = &mut map.as_mut()[..HEADER_LEN];
+        header[..4].copy_from_slice(MAGIC);
+        header[4..6].copy_from_slice(&VERSION.to_le_bytes());
+        header[6..8].copy_from_slice(&(RECORD_LEN as u16).to_le_bytes());
+        header[8..12].copy_from_slice(&(capacity as u32).to_le_bytes());
+        header[12..WRITTEN_AT].fill(0);
+        header[WRITTEN_AT..24].copy_from_slice(&0u64.to_le_bytes());
+        header[24..32].copy_from_slice(&started_unix_us.to_le_bytes());
+        Self {
+            map,
+            capacity: capacity as u64,
+            written: 0,
+            rings: Vec::new(),
+            lights: 0,
+            start,
+        }
+    }
+
+    fn elapsed_ns(&self) -> u64 {
+        self.start.elapsed().as_nanos() as u64
+    }
+
+    fn store(&mut self, record: &Record) {
+        let at = HEADER_LEN + (self.written % self.capacity) as usize * RECORD_LEN;
+        record.write(&mut self.map.as_mut()[at..at + RECORD_LEN]);
+        self.written += 1;
+    }
+
+    /// Number a new light and hand out its transmit and receive taps.
+    fn tap(&mut self, id: &str) -> (Tap, Tap) {
+        let light = self.lights;
+        self.lights = self.lights.wrapping_add(1);
+        let tail = &id.as_bytes()[id.len().saturating_sub(RECORD_DATA)..];
+        self.store(&Record::new(self.elapsed_ns(), light, Kind::Open, tail));
+        let mut tap = |kind| {
+            let ring = Arc::new(Ring::new(light));
+            self.rings.push((ring.clone(), 0));
+            Tap {
+                ring,
+                kind,
+                start: self.start,
+            }
+        };
+        (tap(Kind::Tx), tap(Kind::Rx))
+    }
+
+    /// Move everything queued into the file. Rings whose task has ended are
+    /// dropped once empty.
+    fn drain(&mut self) {
+        let mut rings = std::mem::take(&mut self.rings);
+        rings.retain_mut(|(ring, reported)| {
+            // Checked first: nothing can be pushed after the tap is gone.
+            let closed = Arc::strong_count(ring) == 1;
+            ring.drain(|record| self.store(record));
+            let dropped = ring.dropped.load(Ordering::Relaxed);
+            if dropped > *reported {
+                let count = ((dropped - *reported) as u32).to_le_bytes();
+                let record = Record::new(self.elapsed_ns(), ring.light, Kind::Dropped, &count);
+                self.store(&record);
+                *reported = dropped;
+            }
+            !closed
+        });
+        self.rings = rings;
+        self.map.as_mut()[WRITTEN_AT..WRITTEN_AT + 8].copy_from_slice(&self.written.to_le_bytes());
+    }
+}
+
+static CAPTURE: OnceLock<Mutex<Writer>> = OnceLock::new();
+
+/// Capture into `path`, keeping the latest `records`.
+pub fn start(path: &Path, records: usize) -> Result<(), String> {
+    let capacity = records.clamp(1, u32::MAX as usize);
+    let file = OpenOptions::new()
+        .read(true)
+        .write(true)
+        .create(true)
+        .truncate(true)
+        .open(path)
+        .map_err(|e| format!("Failed to create {}: {e}", path.display()))?;
+    file.set_len((HEADER_LEN + capacity * RECORD_LEN) as u64)
+        .map_err(|e| format!("Failed to size {}: {e}", path.display()))?;
+    // Created above and only ever written through this map.
+    let map = unsafe { MmapMut::map_mut(&file) }
+        .map_err(|e| format!("Failed to map {}: {e}", path.display()))?;
+    let writer = Writer::new(map, capacity, Instant::now());
+    CAPTURE
+        .set(Mutex::new(writer))
+        .map_err(|_| "A capture is already running".to_string())?;
+    std::thread::spawn(|| loop {
+        std::thread::sleep(DRAIN_INTERVAL);
+        if let Some(writer) = CAPTURE.get() {
+            writer.lock().unwrap().drain();
+        }
+    });
+    Ok(())
+}
+
+/// Capture into `$NEEWER_CAPTURE`, if it is set.
+pub fn start_from_env() -> Result<(), String> {
+    match std::env::var_os("NEEWER_CAPTURE") {
+        Some(path) => start(Path::new(&path), DEFAULT_RECORDS),
+        None => Ok(()),
+    }
+}
+
+/// Taps for a newly connected light's writer and reader, or None when not
+/// capturing.
+pub fn tap(id: &str) -> Option<(Tap, Tap)> {
+    Some(CAPTURE.get()?.lock().unwrap().tap(id))
+}
+
+/// Write out everything captured so far.
+pub fn stop() {
+    if let Some(writer) = CAPTURE.get() {
+        let mut writer = writer.lock().unwrap();
+        writer.drain();
+        let _ = writer.map.flush();
+    }
+}
+
+/// A capture file read back.
+pub struct Recording {
+    pub started_unix_us: u64,
+    /// In time order.
+    pub records: Vec<Record>,
+    /// Older records the ring wrapped over.
+    pub overwritten: u64,
+}
+
+impl Recording {
+    pub fn open(path: &Path) -> Result<Self, String> {
+        let bytes =
+            fs::read(path).map_err(|e| format!("Failed to read {}: {e}", path.display()))?;
+        Self::parse(&bytes)
+    }
+
+    pub fn parse(b: &[u8]) -> Result<Self, String> {
+        if b.len() < HEADER_LEN || &b[..4] != MAGIC {
+            return Err("Not a capture file".into());
+        }
+        let version = u16::from_le_bytes([b[4], b[5]]);
+        if version != VERSION || u16::from_le_bytes([b[6], b[7]]) as usize != RECORD_LEN {
+            return Err(format!("Unsupported capture version {version}"));
+        }
+        let capacity = u32::from_le_bytes(b[8..12].try_into().unwrap()) as u64;
+        let expected = HEADER_LEN + capacity as usize * RECORD_LEN;
+        if capacity == 0 || b.len() != expected {
+            return Err(format!(
+                "Capture is {} bytes, header says {expected}",
+                b.len()
+            ));
+        }
+        let written = u64::from_le_bytes(b[WRITTEN_AT..WRITTEN_AT + 8].try_into().unwrap());
+        let first = written.saturating_sub(capacity);
+        let mut records = Vec::with_capacity((written - first) as usize);
+        for n in first..written {
+            let at = HEADER_LEN + (n % capacity) as usize * RECORD_LEN;
+            let record = Record::read(&b[at..at + RECORD_LEN])
+                .ok_or_else(|| format!("Record {n} is corrupt"))?;
+            records.push(record);
+        }
+        // Each task's records are in order already; this interleaves them.
+        records.sort_by_key(|r| r.t_ns);
+        Ok(Self {
+            started_unix_us: u64::from_le_bytes(b[24..32].try_into().unwrap()),
+            records,
+            overwritten: first,
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn writer(capacity: usize) -> Writer<Vec<u8>> {
+        let map = vec![0; HEADER_LEN + capacity * RECORD_LEN];
+        Writer::new(map, capacity, Instant::now())
+    }
+
+    #[test]
+    fn test_round_trip() {
+        let mut writer = writer(64);
+        let (mut tx, mut rx) = writer.tap("/dev/cu.usbserial-1420");
+        tx.record(&[0x3A, 0x02, 0x03, 0x01, 0x32, 0x09, 0x00, 0x79]);
+        let noise: Vec<u8> = (0..45).collect();
+        rx.record(&noise);
+        writer.drain();
+
+        let recording = Recording::parse(&writer.map).unwrap();
+        assert_eq!(recording.overwritten, 0);
+        let kinds: Vec<_> = recording.records.iter().map(|r| r.kind).collect();
+        assert_eq!(kinds, [Kind::Open, Kind::Tx, Kind::Rx, Kind::Rx, Kind::Rx]);
+        assert_eq!(recording.records[0].bytes(), &b"/dev/cu.usbserial-1420"[2..]);
+        let received: Vec<u8> = recording.records[2..]
+            .iter()
+            .flat_map(|r| r.bytes().to_vec())
+            .collect();
+        assert_eq!(received, noise);
+        assert!(recording.records.iter().all(|r| r.light == 0));
+    }
+
+    #[test]
+    fn test_file_wraps_to_latest() {
+        let mut writer = writer(4);
+        let (mut tx, _rx) = writer.tap("A1");
+        for b in 0..10u8 {
+            tx.record(&[b]);
+        }
+        writer.drain();
+        let recording = Recording::parse(&writer.map).unwrap();
+        assert_eq!(recording.overwritten, 7);
+        let bytes: Vec<u8> = recording.records.iter().map(|r| r.bytes()[0]).collect();
+        assert_eq!(bytes, [6, 7, 8, 9]);
+    }
+
+    #[test]
+    fn test_full_ring_drops_and_says_so() {
+        let mut writer = writer(2 * RING_SLOTS);
+        let (mut tx, rx) = writer.tap("A1");
+        for _ in 0..RING_SLOTS + 5 {
+            tx.record(&[0]);
+        }
+        // Both taps gone: their rings are dropped once drained.
+        drop((tx, rx));
+        writer.drain();
+        assert!(writer.rings.is_empty());
+
+        let recording = Recording::parse(&writer.map).unwrap();
+        let dropped = recording.records.last().unwrap();
+        assert_eq!(dropped.kind, Kind::Dropped);
+        assert_eq!(dropped.bytes(), 5u32.to_le_bytes());
+        assert_eq!(recording.records.len(), 1 + RING_SLOTS + 1);
+    }
+
+    #[test]
+    fn test_parse_rejects_damage() {
+        let mut writer = writer(4);
+        writer.tap("A1");
+        writer.drain();
+        let mut bytes = writer.map.clone();
+        assert!(Recording::parse(&bytes[..bytes.len() - 1]).is_err());
+        bytes[HEADER_LEN + 10] = 9;
+        assert!(Recording::parse(&bytes).is_err());
+        assert!(Recording::parse(b"NWTL").is_err());
+    }
+}
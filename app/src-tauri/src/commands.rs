@@ -1,41 +1,256 @@
 /// Tauri commands exposed to the frontend.
 use tauri::State;
 
-use crate::protocol;
-use crate::serial::SerialManager;
+use crate::fleet::{self, Fleet, LightInfo, PortLatency, SceneLight};
+use crate::latency::{self, StageStats, Trace};
+use crate::light_state::{LightState, PanelState, PresetTable, Snapshot};
+use crate::protocol::Cct;
+use crate::serial::Priority;
+use crate::settings::Settings;
+use crate::shortcuts;
+use crate::timeline::Timeline;
+use crate::transition::{self, ConversionTables, Curve, TransitionEngine};
 
 #[tauri::command]
-pub fn quit_app(app: tauri::AppHandle) {
+pub fn quit_app(app: tauri::AppHandle, settings: State<'_, Settings>) {
+    let _ = settings.flush();
     app.exit(0);
 }
 
+#[tauri::command]
+pub fn settings_get(settings: State<'_, Settings>) -> serde_json::Map<String, serde_json::Value> {
+    settings.get_all()
+}
+
+/// Gamma and Kelvin lookup tables for the panel.
+#[tauri::command]
+pub fn conversion_tables() -> ConversionTables {
+    transition::TABLES
+}
+
+#[tauri::command]
+pub fn get_panel_state(light: State<'_, LightState>) -> Snapshot {
+    light.snapshot()
+}
+
+/// Panel slider or power change; `brightness` is the slider position.
+#[tauri::command]
+pub fn set_panel_state(
+    brightness: f64,
+    kelvin: u32,
+    is_on: bool,
+    trace: Option<Trace>,
+    app: tauri::AppHandle,
+    light: State<'_, LightState>,
+) -> Result<(), String> {
+    let state = PanelState {
+        brightness: brightness.clamp(0.0, 100.0),
+        kelvin,
+        is_on,
+    };
+    light.set(&app, state, trace)
+}
+
+#[tauri::command]
+pub fn toggle_power(app: tauri::AppHandle, light: State<'_, LightState>) -> Snapshot {
+    light.toggle(&app)
+}
+
+#[tauri::command]
+pub fn apply_preset(
+    index: usize,
+    app: tauri::AppHandle,
+    light: State<'_, LightState>,
+) -> Result<Snapshot, String> {
+    light.apply_preset(&app, index)
+}
+
+#[tauri::command]
+pub fn save_preset(
+    app: tauri::AppHandle,
+    light: State<'_, LightState>,
+) -> Result<PresetTable, String> {
+    light.save_preset(&app)
+}
+
+#[tauri::command]
+pub fn delete_preset(
+    index: usize,
+    app: tauri::AppHandle,
+    light: State<'_, LightState>,
+) -> Result<PresetTable, String> {
+    light.delete_preset(&app, index)
+}
+
+/// Re-register global shortcuts after `shortcutConfig` or presets changed.
+#[tauri::command]
+pub fn reload_shortcuts(app: tauri::AppHandle) -> Result<(), String> {
+    shortcuts::register(&app)
+}
+
+/// Merge `patch` into the settings; written to disk once changes go quiet.
+#[tauri::command]
+pub fn settings_update(
+    patch: serde_json::Map<String, serde_json::Value>,
+    settings: State<'_, Settings>,
+) {
+    settings.update(patch);
+}
+
 #[tauri::command]
 pub fn list_ports() -> Vec<String> {
-    serialport::available_ports()
-        .unwrap_or_default()
-        .into_iter()
-        .filter(|p| p.port_name.contains("usbserial"))
-        .map(|p| p.port_name)
-        .collect()
+    fleet::discover().into_iter().map(|p| p.path).collect()
 }
 
+/// Known lights with their connection status and last confirmed state,
+/// answered from the link caches without a round-trip to any light.
 #[tauri::command]
-pub fn connect(path: String, app: tauri::AppHandle, state: State<'_, SerialManager>) -> Result<(), String> {
-    state.connect(&path, app)
+pub fn list_lights(state: State<'_, Fleet>) -> Vec<LightInfo> {
+    state.lights()
 }
 
 #[tauri::command]
-pub fn disconnect(state: State<'_, SerialManager>) {
-    state.disconnect();
+pub async fn connect(
+    path: String,
+    app: tauri::AppHandle,
+    state: State<'_, Fleet>,
+) -> Result<(), String> {
+    state.connect(&path, app).await.map(|_| ())
 }
 
 #[tauri::command]
-pub fn is_connected(state: State<'_, SerialManager>) -> bool {
+pub fn disconnect(state: State<'_, Fleet>) {
+    state.disconnect_all();
+}
+
+#[tauri::command]
+pub fn is_connected(state: State<'_, Fleet>) -> bool {
     state.is_connected()
 }
 
 #[tauri::command]
-pub fn set_light(brightness: u8, kelvin: u32, state: State<'_, SerialManager>) -> Result<(), String> {
-    let cmd = protocol::cct_command(brightness, kelvin);
-    state.write(&cmd)
+pub fn set_light(
+    brightness: u8,
+    kelvin: u32,
+    trace: Option<Trace>,
+    state: State<'_, Fleet>,
+    engine: State<'_, TransitionEngine>,
+) -> Result<(), String> {
+    engine.set(brightness, kelvin);
+    let cct = Cct::new(brightness, kelvin);
+    if let Some(trace) = trace {
+        latency::begin(cct, trace);
+    }
+    state.submit_all(cct, Priority::Interactive)
+}
+
+#[tauri::command]
+pub fn set_light_group(
+    ids: Vec<String>,
+    brightness: u8,
+    kelvin: u32,
+    state: State<'_, Fleet>,
+    engine: State<'_, TransitionEngine>,
+) -> Result<(), String> {
+    engine.set(brightness, kelvin);
+    state.submit_group(&ids, Cct::new(brightness, kelvin), Priority::Interactive)
+}
+
+/// Set several lights to their own states at once, sending only to the
+/// ones that change. Returns the ids that were sent to.
+#[tauri::command]
+pub fn apply_scene(
+    lights: Vec<SceneLight>,
+    state: State<'_, Fleet>,
+    engine: State<'_, TransitionEngine>,
+) -> Result<Vec<String>, String> {
+    engine.stop();
+    state.apply_scene(&lights)
+}
+
+/// Fade to `brightness` (slider units, 0-100, gamma applied like the panel
+/// sliders) and `kelvin` over `duration_ms`, stepped by the backend.
+#[tauri::command]
+pub fn fade_to(
+    brightness: f64,
+    kelvin: u32,
+    duration_ms: u64,
+    curve: Option<Curve>,
+    ids: Option<Vec<String>>,
+    app: tauri::AppHandle,
+    engine: State<'_, TransitionEngine>,
+    light: State<'_, LightState>,
+) {
+    if ids.is_none() {
+        light.record(
+            &app,
+            PanelState {
+                brightness: brightness.clamp(0.0, 100.0),
+                kelvin,
+                is_on: brightness > 0.0,
+            },
+        );
+    }
+    engine.fade_to(
+        app,
+        brightness,
+        kelvin,
+        std::time::Duration::from_millis(duration_ms),
+        curve.unwrap_or_default(),
+        ids,
+    );
+}
+
+/// Play a compiled timeline file (see `timeline`) from the start.
+#[tauri::command]
+pub fn play_timeline(
+    path: String,
+    app: tauri::AppHandle,
+    engine: State<'_, TransitionEngine>,
+) -> Result<(), String> {
+    let timeline = Timeline::open(std::path::Path::new(&path))?;
+    engine.play(app, timeline);
+    Ok(())
+}
+
+/// Stop a running timeline or fade where it is.
+#[tauri::command]
+pub fn stop_timeline(engine: State<'_, TransitionEngine>) {
+    engine.stop();
+}
+
+/// Like `set_light_group`, but compensates each port's measured latency so
+/// the change lands on every panel at the same instant.
+#[tauri::command]
+pub fn set_light_group_synced(
+    ids: Vec<String>,
+    brightness: u8,
+    kelvin: u32,
+    state: State<'_, Fleet>,
+    engine: State<'_, TransitionEngine>,
+) -> Result<(), String> {
+    engine.set(brightness, kelvin);
+    state.submit_synced(&ids, Cct::new(brightness, kelvin))
+}
+
+#[tauri::command]
+pub fn port_latencies(state: State<'_, Fleet>) -> Vec<PortLatency> {
+    state.latencies()
+}
+
+/// Per-stage p50/p99 of traced slider changes, for the settings debug panel.
+#[tauri::command]
+pub fn latency_stats() -> Vec<StageStats> {
+    latency::stats()
+}
+
+#[tauri::command]
+pub fn reset_latency_stats() {
+    latency::reset();
+}
+
+/// How many commands each light may have awaiting their echo at once.
+#[tauri::command]
+pub fn set_pipeline_window(window: usize, state: State<'_, Fleet>) {
+    state.set_window(window);
 }
@@ -0,0 +1,296 @@
+/// Local socket API for scripts and the Python CLI (unix only).
+///
+/// The app already holds every light's port open, so a client connects to a
+/// Unix domain socket instead of opening the port itself, and a command costs
+/// one round-trip here rather than a port open, drain and echo wait. The
+/// protocol is one request line, one reply line:
+///
+/// ```text
+/// set <brightness 0-100> [kelvin]   ->  ok brightness=<b> kelvin=<k> on=<0|1>
+/// toggle | preset <n> | state       ->  ok ...
+/// lights                            ->  ok <id>=<b>:<k> <id>=? ...
+/// anything that fails               ->  err <message>
+/// ```
+///
+/// Brightness here is the hardware percentage, as the CLI has always used.
+/// Changes go through `LightState`, so an open panel follows them. `lights`
+/// lists each connected light's last confirmed state from the link cache,
+/// `?` until the light has echoed or reported anything.
+use std::fs;
+use std::io::{BufRead, BufReader, ErrorKind, Write};
+use std::os::unix::fs::{DirBuilderExt, MetadataExt, PermissionsExt};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, Ordering};
+
+use tauri::{AppHandle, Manager};
+
+use crate::fleet::Fleet;
+use crate::light_state::{LightState, PanelState, Snapshot};
+use crate::serial::LinkSnapshot;
+use crate::transition;
+
+/// Set once this instance owns the socket file.
+static SERVING: AtomicBool = AtomicBool::new(false);
+
+const SOCKET_NAME: &str = "neewer-usb-control.sock";
+
+/// `$NEEWER_SOCKET`, or a fixed name in a directory only this user can
+/// enter: `$XDG_RUNTIME_DIR` where the session has one, else `private_dir`.
+/// A socket straight in a shared /tmp could be taken by another user first.
+/// The CLI (`DAEMON_SOCKET`) looks in the same places.
+pub fn socket_path() -> PathBuf {
+    if let Some(path) = std::env::var_os("NEEWER_SOCKET") {
+        return PathBuf::from(path);
+    }
+    std::env::var_os("XDG_RUNTIME_DIR")
+        .map(PathBuf::from)
+        .unwrap_or_else(private_dir)
+        .join(SOCKET_NAME)
+}
+
+fn uid() -> u32 {
+    unsafe { libc::getuid() }
+}
+
+/// `neewer-usb-control-<uid>` in the temp directory, made 0700 by `bind`.
+fn private_dir() -> PathBuf {
+    std::env::temp_dir().join(format!("neewer-usb-control-{}", uid()))
+}
+
+/// Create `dir` 0700 if it is missing, then check that it is a directory of
+/// ours that nobody else can enter, whoever created it.
+fn make_private(dir: &Path) -> Result<(), String> {
+    match fs::DirBuilder::new().mode(0o700).create(dir) {
+        Err(e) if e.kind() != ErrorKind::AlreadyExists => {
+            return Err(format!("Failed to create {}: {e}", dir.display()));
+        }
+        _ => {}
+    }
+    let meta = fs::symlink_metadata(dir).map_err(|e| format!("{}: {e}", dir.display()))?;
+    if !meta.is_dir() || meta.uid() != uid() || meta.mode() & 0o077 != 0 {
+        return Err(format!("{} is not private to this user", dir.display()));
+    }
+    Ok(())
+}
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum Request {
+    Set {
+        brightness: u8,
+        kelvin: Option<u32>,
+    },
+    Toggle,
+    /// 1-based, as the shortcut keys are.
+    Preset(usize),
+    State,
+    Lights,
+}
+
+fn parse(line: &str) -> Result<Request, String> {
+    let mut words = line.split_whitespace();
+    let verb = words.next().ok_or("empty request")?;
+    let mut arg = |name: &str| -> Result<Option<u32>, String> {
+        words
+            .next()
+            .map(|w| w.parse().map_err(|_| format!("bad {name}: {w}")))
+            .transpose()
+    };
+    let request = match verb {
+        "set" => Request::Set {
+            brightness: arg("brightness")?.ok_or("set needs a brightness")?.min(100) as u8,
+            kelvin: arg("kelvin")?,
+        },
+        "toggle" => Request::Toggle,
+        "preset" => match arg("preset")? {
+            Some(n) if n >= 1 => Request::Preset(n as usize - 1),
+            _ => return Err("preset needs a number from 1".into()),
+        },
+        "state" => Request::State,
+        "lights" => Request::Lights,
+        _ => return Err(format!("unknown request: {verb}")),
+    };
+    match words.next() {
+        Some(extra) => Err(format!("unexpected argument: {extra}")),
+        None => Ok(request),
+    }
+}
+
+/// Slider position that maps back to exactly `hw`. `hw_to_slider` rounds to
+/// whole slider steps, which can land one hardware step off.
+fn slider_for(hw: u8) -> f64 {
+    (hw as f64 / 100.0).powf(1.0 / transition::BRI_GAMMA) * 100.0
+}
+
+fn reply(snapshot: &Snapshot) -> String {
+    let state = snapshot.state;
+    format!(
+        "ok brightness={} kelvin={} on={}",
+        state.hw_brightness(),
+        state.kelvin,
+        state.is_on as u8
+    )
+}
+
+fn lights_reply(lights: &[(String, LinkSnapshot)]) -> String {
+    let mut out = String::from("ok");
+    for (id, state) in lights.iter().filter(|(_, s)| s.connected) {
+        match (state.brightness, state.kelvin) {
+            (Some(b), Some(k)) => out += &format!(" {id}={b}:{k}"),
+            _ => out += &format!(" {id}=?"),
+        }
+    }
+    out
+}
+
+fn handle(app: &AppHandle, line: &str) -> Result<String, String> {
+    let light = app.state::<LightState>();
+    let snapshot = match parse(line)? {
+        Request::Set { brightness, kelvin } => {
+            let state = PanelState {
+                brightness: slider_for(brightness),
+                kelvin: kelvin.unwrap_or(light.snapshot().state.kelvin),
+                is_on: brightness > 0,
+            };
+            light.apply(app, state)
+        }
+        Request::Toggle => Ok(light.toggle(app)),
+        Request::Preset(index) => light.apply_preset(app, index),
+        Request::State => Ok(light.snapshot()),
+        Request::Lights => return Ok(lights_reply(&app.state::<Fleet>().snapshots())),
+    };
+    snapshot.map(|s| reply(&s))
+}
+
+fn serve(app: &AppHandle, stream: UnixStream) {
+    let Ok(mut writer) = stream.try_clone() else {
+        return;
+    };
+    for line in BufReader::new(stream).lines() {
+        let Ok(line) = line else {
+            return;
+        };
+        let out = handle(app, &line).unwrap_or_else(|e| format!("err {e}"));
+        if writeln!(writer, "{out}").is_err() {
+            return;
+        }
+    }
+}
+
+fn bind() -> Result<UnixListener, String> {
+    let path = socket_path();
+    // Only this user may drive the lights. Inside a 0700 directory nobody
+    // else can reach the socket even before it is restricted below.
+    if path.parent() == Some(private_dir().as_path()) {
+        make_private(&private_dir())?;
+    }
+    if let Ok(meta) = fs::symlink_metadata(&path) {
+        if meta.uid() != uid() {
+            return Err(format!("{} belongs to another user", path.display()));
+        }
+        // A socket nobody answers on is left over from a crash.
+        if UnixStream::connect(&path).is_ok() {
+            return Err(format!("{} is already being served", path.display()));
+        }
+        let _ = fs::remove_file(&path);
+    }
+    let listener =
+        UnixListener::bind(&path).map_err(|e| format!("Failed to bind {}: {e}", path.display()))?;
+    fs::set_permissions(&path, fs::Permissions::from_mode(0o600))
+        .map_err(|e| format!("Failed to restrict {}: {e}", path.display()))?;
+    Ok(listener)
+}
+
+/// Serve the socket on a background thread, one thread per client.
+pub fn start(app: AppHandle) -> Result<(), String> {
+    let listener = bind()?;
+    SERVING.store(true, Ordering::Relaxed);
+    std::thread::spawn(move || {
+        for stream in listener.incoming().flatten() {
+            let app = app.clone();
+            std::thread::spawn(move || serve(&app, stream));
+        }
+    });
+    Ok(())
+}
+
+/// Remove the socket on quit so clients fall back straight away.
+pub fn stop() {
+    if SERVING.load(Ordering::Relaxed) {
+        let _ = fs::remove_file(socket_path());
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_make_private_rejects_shared_dir() {
+        let dir = std::env::temp_dir().join(format!("neewer-private-test-{}", std::process::id()));
+        let _ = fs::remove_dir_all(&dir);
+        make_private(&dir).unwrap();
+        assert_eq!(fs::metadata(&dir).unwrap().mode() & 0o777, 0o700);
+        // Open to other users: not trusted.
+        fs::set_permissions(&dir, fs::Permissions::from_mode(0o777)).unwrap();
+        assert!(make_private(&dir).is_err());
+        fs::remove_dir(&dir).unwrap();
+    }
+
+    #[test]
+    fn test_parse_requests() {
+        assert_eq!(
+            parse("set 50 4000"),
+            Ok(Request::Set {
+                brightness: 50,
+                kelvin: Some(4000)
+            })
+        );
+        assert_eq!(
+            parse(" set 150 "),
+            Ok(Request::Set {
+                brightness: 100,
+                kelvin: None
+            })
+        );
+        assert_eq!(parse("preset 2"), Ok(Request::Preset(1)));
+        assert_eq!(parse("toggle"), Ok(Request::Toggle));
+        assert_eq!(parse("lights"), Ok(Request::Lights));
+        assert!(parse("preset 0").is_err());
+        assert!(parse("set").is_err());
+        assert!(parse("set -1").is_err());
+        assert!(parse("state now").is_err());
+        assert!(parse("").is_err());
+    }
+
+    #[test]
+    fn test_lights_reply() {
+        let lights = [
+            (
+                "A1".to_string(),
+                LinkSnapshot {
+                    connected: true,
+                    brightness: Some(40),
+                    kelvin: Some(5600),
+                },
+            ),
+            (
+                "B2".to_string(),
+                LinkSnapshot {
+                    connected: true,
+                    ..LinkSnapshot::default()
+                },
+            ),
+            ("C3".to_string(), LinkSnapshot::default()),
+        ];
+        assert_eq!(lights_reply(&lights), "ok A1=40:5600 B2=?");
+        assert_eq!(lights_reply(&[]), "ok");
+    }
+
+    #[test]
+    fn test_set_brightness_is_exact() {
+        for hw in 0..=100 {
+            assert_eq!(transition::slider_to_hw(slider_for(hw)), hw);
+        }
+    }
+}
@@ -0,0 +1,431 @@
+/// Multi-light fleet — one `SerialManager` (connection, reader and writer
+/// task) per USB serial port.
+///
+/// Lights are keyed by the adapter's USB serial number when it reports one,
+/// and by port path otherwise. On macOS the path is derived from the USB
+/// location ID (`/dev/cu.usbserial-<location>`), so it stays stable for a
+/// given hub socket.
+///
+/// Each light's model comes from its USB identity (`USB_MODELS`) and stays
+/// with its fleet entry; its link encodes for that model.
+///
+/// Group writes just post into each light's mailbox; the per-port writer
+/// tasks then send in parallel, so a scene change reaches every panel at
+/// once instead of one port after another. Synchronized group writes go one
+/// step further and stagger the posts by each port's measured latency.
+use std::collections::BTreeMap;
+use std::sync::{
+    atomic::{AtomicUsize, Ordering},
+    Arc, RwLock,
+};
+use std::time::{Duration, Instant};
+
+use serde::{Deserialize, Serialize};
+use tauri::AppHandle;
+
+use crate::model::ModelKind;
+use crate::protocol::Cct;
+use crate::serial::{self, LinkCounters, LinkSnapshot, Priority, SerialManager};
+
+/// QinHeng CH340, the PL81-Pro's USB serial bridge.
+pub const CH340_VID: u16 = 0x1A86;
+pub const CH340_PID: u16 = 0x7523;
+
+struct UsbModel {
+    vid: u16,
+    pid: u16,
+    /// Substring of the USB product string, if the bridge alone is ambiguous.
+    product: Option<&'static str>,
+    model: ModelKind,
+}
+
+/// Known USB identities, first match wins. The PL81-Pro's CH340 reports no
+/// product; other models are added here once their identity is known.
+const USB_MODELS: &[UsbModel] = &[UsbModel {
+    vid: CH340_VID,
+    pid: CH340_PID,
+    product: None,
+    model: ModelKind::Pl81Pro,
+}];
+
+fn identify(usb: &serialport::UsbPortInfo) -> Option<ModelKind> {
+    USB_MODELS
+        .iter()
+        .find(|m| {
+            m.vid == usb.vid
+                && m.pid == usb.pid
+                && m.product.map_or(true, |p| {
+                    usb.product.as_deref().is_some_and(|name| name.contains(p))
+                })
+        })
+        .map(|m| m.model)
+}
+
+/// A light attached to this machine, connected or not.
+#[derive(Debug, Clone, Serialize)]
+pub struct PortInfo {
+    pub id: String,
+    pub path: String,
+    pub model: ModelKind,
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct LightInfo {
+    pub id: String,
+    pub path: String,
+    pub model: ModelKind,
+    #[serde(flatten)]
+    pub state: LinkSnapshot,
+}
+
+/// One light's part of a scene. Brightness is the hardware percentage.
+#[derive(Debug, Clone, Deserialize)]
+pub struct SceneLight {
+    pub id: String,
+    pub brightness: u8,
+    pub kelvin: u32,
+}
+
+/// Echo timing and delivery for one light, for charting and sync diagnostics.
+#[derive(Debug, Clone, Serialize)]
+pub struct PortLatency {
+    pub id: String,
+    #[serde(flatten)]
+    pub counters: LinkCounters,
+}
+
+struct Light {
+    path: String,
+    serial: Arc<SerialManager>,
+}
+
+pub struct Fleet {
+    lights: RwLock<BTreeMap<String, Light>>,
+    /// In-flight window applied to every light, including ones added later.
+    window: AtomicUsize,
+}
+
+/// Enumerate attached lights, one entry per device.
+pub fn discover() -> Vec<PortInfo> {
+    let mut found: BTreeMap<String, (String, ModelKind)> = BTreeMap::new();
+    for port in serialport::available_ports().unwrap_or_default() {
+        let (serial_number, model) = match &port.port_type {
+            serialport::SerialPortType::UsbPort(usb) => match identify(usb) {
+                Some(model) => (usb.serial_number.clone(), model),
+                None => continue,
+            },
+            _ if port.port_name.contains("usbserial") => (None, ModelKind::default()),
+            _ => continue,
+        };
+        // macOS lists every device twice; the call-out node is the one to open.
+        if port.port_name.starts_with("/dev/tty.") {
+            continue;
+        }
+        let id = serial_number.unwrap_or_else(|| port.port_name.clone());
+        found.entry(id).or_insert((port.port_name, model));
+    }
+    found
+        .into_iter()
+        .map(|(id, (path, model))| PortInfo { id, path, model })
+        .collect()
+}
+
+/// `discover` off the async runtime: enumerating ports queries the OS device
+/// registry and can block for a while.
+async fn discover_async() -> Vec<PortInfo> {
+    tauri::async_runtime::spawn_blocking(discover)
+        .await
+        .unwrap_or_default()
+}
+
+impl Fleet {
+    pub fn new() -> Self {
+        Self {
+            lights: RwLock::new(BTreeMap::new()),
+            window: AtomicUsize::new(serial::DEFAULT_WINDOW),
+        }
+    }
+
+    /// Connect to the light at `path`, reusing its fleet entry if it has one.
+    /// Returns the light's id.
+    pub async fn connect(&self, path: &str, app: AppHandle) -> Result<String, String> {
+        let (id, model) = discover_async()
+            .await
+            .into_iter()
+            .find(|p| p.path == path)
+            .map(|p| (p.id, p.model))
+            .unwrap_or_else(|| (path.to_string(), ModelKind::default()));
+
+        let serial = {
+            let mut lights = self.lights.write().unwrap();
+            let light = lights.entry(id.clone()).or_insert_with(|| {
+                let serial = SerialManager::with_model(id.clone(), model);
+                serial.set_window(self.window.load(Ordering::Relaxed));
+                Light {
+                    path: path.to_string(),
+                    serial: Arc::new(serial),
+                }
+            });
+            light.path = path.to_string();
+            light.serial.clone()
+        };
+        serial.connect(path, app).await?;
+        Ok(id)
+    }
+
+    /// Bring the fleet in line with the attached lights: close connections
+    /// whose port has gone and connect every light that isn't connected yet.
+    /// Returns the ids that were newly connected.
+    pub async fn reconcile(&self, app: &AppHandle) -> Vec<String> {
+        let present = discover_async().await;
+        for light in self.lights.read().unwrap().values() {
+            if light.serial.is_connected() && !present.iter().any(|p| p.path == light.path) {
+                light.serial.disconnect();
+            }
+        }
+        let mut connected = Vec::new();
+        for port in present {
+            if self.is_light_connected(&port.id) {
+                continue;
+            }
+            if let Ok(id) = self.connect(&port.path, app.clone()).await {
+                connected.push(id);
+            }
+        }
+        connected
+    }
+
+    pub fn disconnect_all(&self) {
+        for light in self.lights.read().unwrap().values() {
+            light.serial.disconnect();
+        }
+    }
+
+    /// True if any light is connected.
+    pub fn is_connected(&self) -> bool {
+        self.lights
+            .read()
+            .unwrap()
+            .values()
+            .any(|l| l.serial.is_connected())
+    }
+
+    fn is_light_connected(&self, id: &str) -> bool {
+        self.lights
+            .read()
+            .unwrap()
+            .get(id)
+            .is_some_and(|l| l.serial.is_connected())
+    }
+
+    pub fn lights(&self) -> Vec<LightInfo> {
+        self.lights
+            .read()
+            .unwrap()
+            .iter()
+            .map(|(id, l)| LightInfo {
+                id: id.clone(),
+                path: l.path.clone(),
+                model: l.serial.model(),
+                state: l.serial.snapshot(),
+            })
+            .collect()
+    }
+
+    /// Every light's connection status and last confirmed state, by id.
+    /// Reads the link caches only; nothing goes out on the wire.
+    #[cfg(unix)]
+    pub fn snapshots(&self) -> Vec<(String, LinkSnapshot)> {
+        self.lights
+            .read()
+            .unwrap()
+            .iter()
+            .map(|(id, l)| (id.clone(), l.serial.snapshot()))
+            .collect()
+    }
+
+    /// Queue `cct` on every connected light.
+    pub fn submit_all(&self, cct: Cct, priority: Priority) -> Result<(), String> {
+        let lights = self.lights.read().unwrap();
+        let sent = lights
+            .values()
+            .filter(|l| l.serial.is_connected() && l.serial.submit(cct, priority).is_ok())
+            .count();
+        if sent == 0 {
+            return Err("Port not open".into());
+        }
+        Ok(())
+    }
+
+    /// Queue `cct` on every connected light that doesn't already show it.
+    /// Returns how many lights it was sent to.
+    pub fn submit_all_changed(&self, cct: Cct) -> Result<usize, String> {
+        let lights = self.lights.read().unwrap();
+        let mut connected = 0;
+        let mut sent = 0;
+        for light in lights.values() {
+            if let Ok(queued) = light.serial.submit_changed(cct) {
+                connected += 1;
+                sent += queued as usize;
+            }
+        }
+        if connected == 0 {
+            return Err("Port not open".into());
+        }
+        Ok(sent)
+    }
+
+    /// Set each light in `scene` to its own state, sending only to lights
+    /// whose brightness or temperature step would change. Returns the ids
+    /// that were sent to. Fails if any light isn't connected, after sending
+    /// to the rest.
+    pub fn apply_scene(&self, scene: &[SceneLight]) -> Result<Vec<String>, String> {
+        let lights = self.lights.read().unwrap();
+        let mut sent = Vec::new();
+        let mut missing = Vec::new();
+        for target in scene {
+            let cct = Cct::new(target.brightness, target.kelvin);
+            match lights.get(&target.id).map(|l| l.serial.submit_changed(cct)) {
+                Some(Ok(true)) => sent.push(target.id.clone()),
+                Some(Ok(false)) => {}
+                _ => missing.push(target.id.as_str()),
+            }
+        }
+        if !missing.is_empty() {
+            return Err(format!("Not connected: {}", missing.join(", ")));
+        }
+        Ok(sent)
+    }
+
+    /// Queue each state on its light, or on every light for `None`, under
+    /// one lock and without allocating. Unknown and disconnected lights are
+    /// skipped. Returns how many posts were made.
+    pub fn submit_batch<'a>(
+        &self,
+        batch: impl IntoIterator<Item = (Option<&'a str>, Cct)>,
+        priority: Priority,
+    ) -> usize {
+        let lights = self.lights.read().unwrap();
+        // Checked first: a failed submit allocates its error.
+        let post =
+            |l: &Light, cct| l.serial.is_connected() && l.serial.submit(cct, priority).is_ok();
+        let mut posted = 0;
+        for (id, cct) in batch {
+            posted += match id {
+                Some(id) => lights.get(id).is_some_and(|l| post(l, cct)) as usize,
+                None => lights.values().filter(|l| post(l, cct)).count(),
+            };
+        }
+        posted
+    }
+
+    /// Queue `cct` on each of `ids`. Fails if any of them isn't connected,
+    /// after queueing on the rest.
+    pub fn submit_group(&self, ids: &[String], cct: Cct, priority: Priority) -> Result<(), String> {
+        let lights = self.lights.read().unwrap();
+        let mut missing = Vec::new();
+        for id in ids {
+            match lights.get(id) {
+                Some(l) if l.serial.submit(cct, priority).is_ok() => {}
+                _ => missing.push(id.as_str()),
+            }
+        }
+        if !missing.is_empty() {
+            return Err(format!("Not connected: {}", missing.join(", ")));
+        }
+        Ok(())
+    }
+
+    /// Queue `cct` on each of `ids` so that it takes effect on all of them
+    /// at the same moment.
+    ///
+    /// A light applies a command roughly half an echo round-trip after the
+    /// write starts. The slowest port is written immediately and the others
+    /// are held back by the difference. Lights without a measurement yet are
+    /// treated as the slowest, which degrades to a plain parallel write.
+    pub fn submit_synced(&self, ids: &[String], cct: Cct) -> Result<(), String> {
+        let lights = self.lights.read().unwrap();
+        let targets: Vec<_> = ids.iter().filter_map(|id| lights.get(id)).collect();
+        let delays: Vec<Option<Duration>> = targets
+            .iter()
+            .map(|l| l.serial.echo_rtt().map(|rtt| rtt / 2))
+            .collect();
+        let lead = delays.iter().flatten().max().copied().unwrap_or_default();
+
+        let now = Instant::now();
+        let mut missing: Vec<&str> = ids
+            .iter()
+            .filter(|id| !lights.contains_key(*id))
+            .map(|id| id.as_str())
+            .collect();
+        for (light, delay) in targets.iter().zip(delays) {
+            let due = now + (lead - delay.unwrap_or(lead));
+            if light.serial.submit_at(cct, due).is_err() {
+                missing.push(light.serial.id());
+            }
+        }
+        if !missing.is_empty() {
+            return Err(format!("Not connected: {}", missing.join(", ")));
+        }
+        Ok(())
+    }
+
+    /// The longest send interval among connected lights: the fastest rate
+    /// at which the whole fleet keeps up.
+    pub fn send_interval(&self) -> Duration {
+        self.lights
+            .read()
+            .unwrap()
+            .values()
+            .filter(|l| l.serial.is_connected())
+            .map(|l| l.serial.send_interval())
+            .max()
+            .unwrap_or_default()
+    }
+
+    /// Set the in-flight window on every light.
+    pub fn set_window(&self, window: usize) {
+        self.window.store(window, Ordering::Relaxed);
+        for light in self.lights.read().unwrap().values() {
+            light.serial.set_window(window);
+        }
+    }
+
+    pub fn latencies(&self) -> Vec<PortLatency> {
+        self.lights
+            .read()
+            .unwrap()
+            .iter()
+            .map(|(id, l)| PortLatency {
+                id: id.clone(),
+                counters: l.serial.counters(),
+            })
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn usb(product: Option<&str>) -> serialport::UsbPortInfo {
+        serialport::UsbPortInfo {
+            vid: CH340_VID,
+            pid: CH340_PID,
+            serial_number: None,
+            manufacturer: None,
+            product: product.map(str::to_string),
+        }
+    }
+
+    #[test]
+    fn test_identify_models() {
+        assert_eq!(identify(&usb(None)), Some(ModelKind::Pl81Pro));
+        assert_eq!(identify(&usb(Some("USB Serial"))), Some(ModelKind::Pl81Pro));
+        let other = serialport::UsbPortInfo {
+            vid: 0x0403,
+            ..usb(None)
+        };
+        assert_eq!(identify(&other), None);
+    }
+}
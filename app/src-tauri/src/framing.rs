@@ -0,0 +1,163 @@
+/// Incremental decoder for the `[0x3A] [tag] [len] [payload...] [cs_hi] [cs_lo]`
+/// packet format.
+///
+/// Bytes are fed in as they arrive from the port; complete, checksum-valid
+/// packets are handed to a callback as a slice into the decoder's fixed
+/// buffer. Nothing is allocated and each byte is touched a bounded number
+/// of times, so garbage on the line costs the same as valid traffic.
+use crate::protocol;
+
+pub const START: u8 = 0x3A;
+/// Prefix, tag and length byte.
+pub const HEADER_LEN: usize = 3;
+pub const CHECKSUM_LEN: usize = 2;
+/// Longest payload we accept. Known commands carry at most 4 bytes; a length
+/// byte above this marks a false start, so a stray 0x3A can't stall framing
+/// while we wait for hundreds of bytes that will never checksum.
+pub const MAX_PAYLOAD: usize = 16;
+pub const MAX_FRAME: usize = HEADER_LEN + MAX_PAYLOAD + CHECKSUM_LEN;
+
+pub struct Framer {
+    buf: [u8; MAX_FRAME],
+    len: usize,
+    resyncs: u64,
+    skipped: u64,
+}
+
+impl Framer {
+    pub fn new() -> Self {
+        Self {
+            buf: [0; MAX_FRAME],
+            len: 0,
+            resyncs: 0,
+            skipped: 0,
+        }
+    }
+
+    /// Consume a chunk of received bytes, calling `on_frame` for every
+    /// complete packet. Partial packets are kept for the next call.
+    pub fn feed(&mut self, data: &[u8], mut on_frame: impl FnMut(&[u8])) {
+        for &byte in data {
+            if self.len == 0 && byte != START {
+                self.skipped += 1;
+                continue;
+            }
+            self.buf[self.len] = byte;
+            self.len += 1;
+            self.settle(&mut on_frame);
+        }
+    }
+
+    /// Number of candidate packets rejected (bad length or checksum).
+    pub fn resyncs(&self) -> u64 {
+        self.resyncs
+    }
+
+    /// Number of bytes discarded while hunting for a start byte.
+    pub fn skipped(&self) -> u64 {
+        self.skipped
+    }
+
+    /// Drop any partially received packet.
+    pub fn reset(&mut self) {
+        self.len = 0;
+    }
+
+    /// Emit or reject the buffered candidate once enough of it has arrived.
+    /// A rejected candidate only loses its start byte: the bytes after it are
+    /// rescanned, since the real packet may begin inside them.
+    fn settle(&mut self, on_frame: &mut impl FnMut(&[u8])) {
+        while self.len >= HEADER_LEN {
+            let payload_len = self.buf[2] as usize;
+            if payload_len > MAX_PAYLOAD {
+                self.resyncs += 1;
+                self.consume(1);
+                continue;
+            }
+            let need = HEADER_LEN + payload_len + CHECKSUM_LEN;
+            if self.len < need {
+                return;
+            }
+            let cs = protocol::checksum(&self.buf[..need - CHECKSUM_LEN]);
+            if cs == [self.buf[need - 2], self.buf[need - 1]] {
+                on_frame(&self.buf[..need]);
+                self.consume(need);
+            } else {
+                self.resyncs += 1;
+                self.consume(1);
+            }
+        }
+    }
+
+    /// Discard the first `n` buffered bytes and realign on the next start byte.
+    fn consume(&mut self, n: usize) {
+        match self.buf[n..self.len].iter().position(|&b| b == START) {
+            Some(p) => {
+                let start = n + p;
+                self.skipped += p as u64;
+                self.buf.copy_within(start..self.len, 0);
+                self.len -= start;
+            }
+            None => {
+                self.skipped += (self.len - n) as u64;
+                self.len = 0;
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn collect(framer: &mut Framer, data: &[u8]) -> Vec<Vec<u8>> {
+        let mut out = Vec::new();
+        framer.feed(data, |f| out.push(f.to_vec()));
+        out
+    }
+
+    #[test]
+    fn test_clean_stream() {
+        let a = protocol::cct_command(100, 7000);
+        let b = protocol::cct_command(10, 2900);
+        let stream = [&a[..], &b[..]].concat();
+        let frames = collect(&mut Framer::new(), &stream);
+        assert_eq!(frames, vec![a.to_vec(), b.to_vec()]);
+    }
+
+    #[test]
+    fn test_fragmented_and_variable_length() {
+        let a = protocol::power_command(true);
+        let b = protocol::hsi_command(300, 100, 50);
+        let stream = [&a[..], &b[..]].concat();
+        let mut framer = Framer::new();
+        let mut frames = Vec::new();
+        for byte in stream {
+            frames.extend(collect(&mut framer, &[byte]));
+        }
+        assert_eq!(frames, vec![a.to_vec(), b.to_vec()]);
+    }
+
+    #[test]
+    fn test_resync_after_garbage_and_bad_checksum() {
+        let good = protocol::cct_command(50, 4950);
+        let mut bad = protocol::cct_command(60, 4950).to_vec();
+        bad[7] ^= 0xFF;
+        // Noise, a stray start byte with a huge length, a packet with a bad
+        // checksum, then a good packet.
+        let stream = [&[0x00, 0xFF, 0x3A, 0x02, 0xF0][..], &bad[..], &good[..]].concat();
+        let mut framer = Framer::new();
+        let frames = collect(&mut framer, &stream);
+        assert_eq!(frames, vec![good.to_vec()]);
+        assert_eq!(framer.resyncs(), 2);
+    }
+
+    #[test]
+    fn test_frame_starting_inside_rejected_candidate() {
+        let good = protocol::cct_command(50, 4950);
+        // A false start whose "payload" swallows the real packet's first bytes.
+        let stream = [&[0x3A, 0x02, 0x03][..], &good[..]].concat();
+        let frames = collect(&mut Framer::new(), &stream);
+        assert_eq!(frames, vec![good.to_vec()]);
+    }
+}
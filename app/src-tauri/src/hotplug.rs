@@ -0,0 +1,256 @@
+/// USB hotplug watcher.
+///
+/// Sleeps on the OS device notifications (IOKit matching notifications on
+/// macOS, kernel uevents on Linux) and reconciles the fleet whenever a serial
+/// device comes or goes. A light is connected within milliseconds of being
+/// plugged in and announced with one "light-connected" event; nothing runs
+/// while no device changes.
+use std::time::Duration;
+
+use tauri::{AppHandle, Emitter, Manager};
+
+use crate::fleet::Fleet;
+use crate::light_state::LightState;
+
+/// Rescan interval where no notification API is available.
+const RESCAN_INTERVAL: Duration = Duration::from_secs(5);
+
+/// Connect the lights already attached, then keep watching on a background
+/// thread for the life of the app.
+pub fn start(app: AppHandle) {
+    std::thread::spawn(move || {
+        // If notifications can't be set up, fall back to rescanning.
+        let _ = imp::run(&app);
+        loop {
+            reconcile(&app);
+            std::thread::sleep(RESCAN_INTERVAL);
+        }
+    });
+}
+
+fn reconcile(app: &AppHandle) {
+    let connected = tauri::async_runtime::block_on(app.state::<Fleet>().reconcile(app));
+    for id in connected {
+        app.state::<LightState>().restore(app, &id);
+        let _ = app.emit("light-connected", &id);
+    }
+}
+
+#[cfg(target_os = "macos")]
+mod imp {
+    use std::ffi::{c_char, c_void};
+
+    use tauri::AppHandle;
+
+    type IoObject = u32;
+    type KernReturn = i32;
+    type MatchingCallback = extern "C" fn(*mut c_void, IoObject);
+
+    #[link(name = "IOKit", kind = "framework")]
+    extern "C" {
+        fn IONotificationPortCreate(main_port: u32) -> *mut c_void;
+        fn IONotificationPortGetRunLoopSource(port: *mut c_void) -> *mut c_void;
+        fn IOServiceMatching(name: *const c_char) -> *mut c_void;
+        fn IOServiceAddMatchingNotification(
+            port: *mut c_void,
+            kind: *const c_char,
+            matching: *mut c_void,
+            callback: MatchingCallback,
+            refcon: *mut c_void,
+            iterator: *mut IoObject,
+        ) -> KernReturn;
+        fn IOIteratorNext(iterator: IoObject) -> IoObject;
+        fn IOObjectRelease(object: IoObject) -> KernReturn;
+    }
+
+    #[link(name = "CoreFoundation", kind = "framework")]
+    extern "C" {
+        static kCFRunLoopDefaultMode: *const c_void;
+        fn CFRunLoopGetCurrent() -> *mut c_void;
+        fn CFRunLoopAddSource(run_loop: *mut c_void, source: *mut c_void, mode: *const c_void);
+        fn CFRunLoopRun();
+    }
+
+    /// Match serial nodes rather than the CH340 USB device itself: the device
+    /// matches before the driver has published `/dev/cu.*`, and the node is
+    /// what we open. `Fleet::reconcile` filters by VID/PID.
+    const SERIAL_CLASS: &[u8] = b"IOSerialBSDClient\0";
+    const FIRST_MATCH: &[u8] = b"IOServiceFirstMatch\0";
+    const TERMINATED: &[u8] = b"IOServiceTerminate\0";
+
+    extern "C" fn on_change(refcon: *mut c_void, iterator: IoObject) {
+        // Draining the iterator re-arms the notification.
+        drain(iterator);
+        let app = unsafe { &*(refcon as *const AppHandle) };
+        super::reconcile(app);
+    }
+
+    fn drain(iterator: IoObject) {
+        loop {
+            let object = unsafe { IOIteratorNext(iterator) };
+            if object == 0 {
+                return;
+            }
+            unsafe { IOObjectRelease(object) };
+        }
+    }
+
+    /// Runs the notification run loop; only returns if setup fails.
+    pub fn run(app: &AppHandle) -> Result<(), String> {
+        unsafe {
+            let port = IONotificationPortCreate(0);
+            if port.is_null() {
+                return Err("IONotificationPortCreate failed".into());
+            }
+            CFRunLoopAddSource(
+                CFRunLoopGetCurrent(),
+                IONotificationPortGetRunLoopSource(port),
+                kCFRunLoopDefaultMode,
+            );
+            // Lives as long as the run loop, i.e. the app.
+            let refcon = Box::into_raw(Box::new(app.clone())) as *mut c_void;
+            for kind in [FIRST_MATCH, TERMINATED] {
+                // Each registration consumes its matching dictionary.
+                let matching = IOServiceMatching(SERIAL_CLASS.as_ptr().cast());
+                let mut iterator = 0;
+                let kr = IOServiceAddMatchingNotification(
+                    port,
+                    kind.as_ptr().cast(),
+                    matching,
+                    on_change,
+                    refcon,
+                    &mut iterator,
+                );
+                if kr != 0 {
+                    return Err(format!("IOServiceAddMatchingNotification failed: {kr:#x}"));
+                }
+                // Arm it; devices already present are picked up just below.
+                drain(iterator);
+            }
+            super::reconcile(app);
+            CFRunLoopRun();
+        }
+        Ok(())
+    }
+}
+
+#[cfg(target_os = "linux")]
+mod imp {
+    use std::io;
+    use std::os::unix::io::{AsRawFd, FromRawFd, OwnedFd};
+    use std::time::Duration;
+
+    use tauri::AppHandle;
+
+    /// Multicast group of the kernel's own uevents.
+    const KERNEL_EVENTS: u32 = 1;
+    /// A plug produces a burst of events (USB device, interface, tty). Wait
+    /// for it to go quiet, which also gives udev time to set permissions.
+    const SETTLE: Duration = Duration::from_millis(100);
+
+    /// Blocks on the uevent socket; only returns if it fails.
+    pub fn run(app: &AppHandle) -> Result<(), String> {
+        let fd = unsafe {
+            libc::socket(
+                libc::AF_NETLINK,
+                libc::SOCK_DGRAM | libc::SOCK_CLOEXEC,
+                libc::NETLINK_KOBJECT_UEVENT,
+            )
+        };
+        if fd < 0 {
+            return Err(format!("uevent socket: {}", io::Error::last_os_error()));
+        }
+        let socket = unsafe { OwnedFd::from_raw_fd(fd) };
+        let mut addr: libc::sockaddr_nl = unsafe { std::mem::zeroed() };
+        addr.nl_family = libc::AF_NETLINK as libc::sa_family_t;
+        addr.nl_groups = KERNEL_EVENTS;
+        let bound = unsafe {
+            libc::bind(
+                socket.as_raw_fd(),
+                &addr as *const libc::sockaddr_nl as *const libc::sockaddr,
+                std::mem::size_of::<libc::sockaddr_nl>() as libc::socklen_t,
+            )
+        };
+        if bound != 0 {
+            return Err(format!("uevent bind: {}", io::Error::last_os_error()));
+        }
+
+        super::reconcile(app);
+        let mut buf = [0u8; 8192];
+        loop {
+            let n = recv(&socket, &mut buf, 0)?;
+            if !is_tty_event(&buf[..n]) {
+                continue;
+            }
+            while readable(&socket, SETTLE) {
+                recv(&socket, &mut buf, libc::MSG_DONTWAIT)?;
+            }
+            super::reconcile(app);
+        }
+    }
+
+    fn recv(socket: &OwnedFd, buf: &mut [u8], flags: libc::c_int) -> Result<usize, String> {
+        loop {
+            let n = unsafe {
+                libc::recv(
+                    socket.as_raw_fd(),
+                    buf.as_mut_ptr().cast(),
+                    buf.len(),
+                    flags,
+                )
+            };
+            if n >= 0 {
+                return Ok(n as usize);
+            }
+            let err = io::Error::last_os_error();
+            match err.kind() {
+                io::ErrorKind::Interrupted => continue,
+                io::ErrorKind::WouldBlock => return Ok(0),
+                _ => return Err(format!("uevent recv: {err}")),
+            }
+        }
+    }
+
+    fn readable(socket: &OwnedFd, timeout: Duration) -> bool {
+        let mut fd = libc::pollfd {
+            fd: socket.as_raw_fd(),
+            events: libc::POLLIN,
+            revents: 0,
+        };
+        unsafe { libc::poll(&mut fd, 1, timeout.as_millis() as libc::c_int) > 0 }
+    }
+
+    /// A uevent is `ACTION@DEVPATH\0KEY=VALUE\0...`. Only tty nodes coming or
+    /// going can change the fleet.
+    pub(super) fn is_tty_event(msg: &[u8]) -> bool {
+        let mut fields = msg.split(|&b| b == 0);
+        let head = fields.next().unwrap_or_default();
+        (head.starts_with(b"add@") || head.starts_with(b"remove@"))
+            && fields.any(|f| f == b"SUBSYSTEM=tty")
+    }
+}
+
+#[cfg(not(any(target_os = "macos", target_os = "linux")))]
+mod imp {
+    use tauri::AppHandle;
+
+    /// No notification source here; `start` falls back to rescanning.
+    pub fn run(_app: &AppHandle) -> Result<(), String> {
+        Err("no hotplug notifications on this platform".into())
+    }
+}
+
+#[cfg(all(test, target_os = "linux"))]
+mod tests {
+    use super::imp::is_tty_event;
+
+    #[test]
+    fn test_tty_uevent_filter() {
+        let add = b"add@/devices/pci0000:00/usb1/1-1/1-1:1.0/ttyUSB0/tty/ttyUSB0\0ACTION=add\0SUBSYSTEM=tty\0DEVNAME=ttyUSB0\0";
+        let bind = b"bind@/devices/pci0000:00/usb1/1-1\0ACTION=bind\0SUBSYSTEM=usb\0";
+        let change = b"change@/devices/virtual/tty/tty1\0ACTION=change\0SUBSYSTEM=tty\0";
+        assert!(is_tty_event(add));
+        assert!(!is_tty_event(bind));
+        assert!(!is_tty_event(change));
+    }
+}
@@ -0,0 +1,367 @@
+/// Slider-to-echo latency tracing.
+///
+/// A traced `set_light` call carries the panel's own timings (input to
+/// dispatch, and when it dispatched). The writer and read loop then close the
+/// remaining stages as that frame is written and echoed. The trace holds the
+/// value's frame for every model, so it matches whichever light sends first. Every stage feeds a
+/// fixed histogram with quarter-octave buckets, read back with `stats`.
+///
+/// `written` and `echoed` run for every frame on every light, so while no
+/// trace is open they return on one atomic load, without the lock.
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
+
+use serde::{Deserialize, Serialize};
+
+use crate::model::ModelKind;
+use crate::protocol::{Cct, CctFrame};
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Stage {
+    /// Slider input to the debounced send (measured in the panel).
+    InputToDispatch,
+    /// Panel dispatch to `set_light` entry: IPC and webview scheduling.
+    DispatchToCommand,
+    /// `set_light` entry to the frame being flushed to the port.
+    CommandToWrite,
+    /// Flushed to echo parsed by the read loop.
+    WriteToEcho,
+    /// Slider input to echo.
+    Total,
+}
+
+const STAGES: [Stage; 5] = [
+    Stage::InputToDispatch,
+    Stage::DispatchToCommand,
+    Stage::CommandToWrite,
+    Stage::WriteToEcho,
+    Stage::Total,
+];
+
+impl Stage {
+    fn name(self) -> &'static str {
+        match self {
+            Stage::InputToDispatch => "inputToDispatch",
+            Stage::DispatchToCommand => "dispatchToCommand",
+            Stage::CommandToWrite => "commandToWrite",
+            Stage::WriteToEcho => "writeToEcho",
+            Stage::Total => "total",
+        }
+    }
+}
+
+/// Panel-side timings sent along with a traced `set_light`.
+#[derive(Debug, Clone, Copy, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct Trace {
+    /// First slider input of the burst to the debounced dispatch.
+    pub input_to_dispatch_ms: f64,
+    /// Wall-clock time of the dispatch (`performance.timeOrigin + now()`).
+    pub dispatched_at_ms: f64,
+}
+
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct StageStats {
+    pub stage: &'static str,
+    pub count: u64,
+    pub p50_us: u64,
+    pub p99_us: u64,
+    pub max_us: u64,
+}
+
+const SUB_BUCKETS: usize = 4;
+/// Exact below 8 µs, then quarter octaves up to ~33 s.
+const BUCKETS: usize = 24 * SUB_BUCKETS;
+
+struct Histogram {
+    counts: [u64; BUCKETS],
+    total: u64,
+    max_us: u64,
+}
+
+impl Histogram {
+    const fn new() -> Self {
+        Self {
+            counts: [0; BUCKETS],
+            total: 0,
+            max_us: 0,
+        }
+    }
+
+    fn bucket(us: u64) -> usize {
+        if us < 8 {
+            return us as usize;
+        }
+        let octave = 63 - us.leading_zeros() as usize;
+        let sub = ((us >> (octave - 2)) & 3) as usize;
+        ((octave - 1) * SUB_BUCKETS + sub).min(BUCKETS - 1)
+    }
+
+    /// Largest value that lands in `bucket`.
+    fn upper(bucket: usize) -> u64 {
+        if bucket < 8 {
+            return bucket as u64;
+        }
+        let octave = bucket / SUB_BUCKETS + 1;
+        let sub = (bucket % SUB_BUCKETS) as u64;
+        ((SUB_BUCKETS as u64 + sub + 1) << (octave - 2)) - 1
+    }
+
+    fn record(&mut self, d: Duration) {
+        let us = d.as_micros().min(u64::MAX as u128) as u64;
+        self.counts[Self::bucket(us)] += 1;
+        self.total += 1;
+        self.max_us = self.max_us.max(us);
+    }
+
+    /// Upper bound of the bucket holding quantile `q` (0..=1).
+    fn quantile(&self, q: f64) -> u64 {
+        let rank = ((self.total as f64 * q).ceil() as u64).max(1);
+        let mut seen = 0;
+        for (bucket, &count) in self.counts.iter().enumerate() {
+            seen += count;
+            if seen >= rank {
+                return Self::upper(bucket).min(self.max_us);
+            }
+        }
+        0
+    }
+}
+
+/// A traced frame on its way to the light.
+#[derive(Clone, Copy)]
+struct Open {
+    /// The value as each model encodes it, in `ModelKind::ALL` order.
+    frames: [CctFrame; ModelKind::ALL.len()],
+    input: Instant,
+    entered: Instant,
+    written: Option<Instant>,
+}
+
+/// Traces awaiting their write and echo. Superseded frames never echo, so
+/// the oldest entry is simply overwritten.
+const OPEN_TRACES: usize = 16;
+/// An open trace older than this won't be written or echoed any more: it
+/// outlasts every resend of its frame.
+const TRACE_TTL: Duration = Duration::from_secs(2);
+
+struct Tracer {
+    open: [Option<Open>; OPEN_TRACES],
+    next: usize,
+    stages: [Histogram; STAGES.len()],
+}
+
+static TRACER: Mutex<Tracer> = Mutex::new(Tracer::new());
+/// `TRACER`'s open trace count, readable without the lock.
+static OPEN_COUNT: AtomicUsize = AtomicUsize::new(0);
+
+impl Tracer {
+    const fn new() -> Self {
+        Self {
+            open: [None; OPEN_TRACES],
+            next: 0,
+            stages: [const { Histogram::new() }; STAGES.len()],
+        }
+    }
+
+    fn record(&mut self, stage: Stage, d: Duration) {
+        self.stages[stage as usize].record(d);
+    }
+
+    fn open_count(&self) -> usize {
+        self.open.iter().flatten().count()
+    }
+
+    /// Close traces that will never complete: superseded or lost frames.
+    fn expire(&mut self, now: Instant) {
+        for slot in &mut self.open {
+            if slot.is_some_and(|o| now >= o.entered + TRACE_TTL) {
+                *slot = None;
+            }
+        }
+    }
+
+    fn find(&mut self, packet: &[u8]) -> Option<&mut Option<Open>> {
+        self.open
+            .iter_mut()
+            .find(|o| o.is_some_and(|o| o.frames.iter().any(|f| f.as_bytes()[..] == *packet)))
+    }
+
+    fn begin(&mut self, cct: Cct, input_to_dispatch: Duration, ipc: Duration, now: Instant) {
+        self.record(Stage::InputToDispatch, input_to_dispatch);
+        self.record(Stage::DispatchToCommand, ipc);
+        let frames = ModelKind::ALL.map(|kind| kind.encode(cct));
+        let open = Open {
+            frames,
+            input: now.checked_sub(input_to_dispatch + ipc).unwrap_or(now),
+            entered: now,
+            written: None,
+        };
+        match self.find(&frames[0]) {
+            Some(slot) => *slot = Some(open),
+            None => {
+                self.open[self.next] = Some(open);
+                self.next = (self.next + 1) % OPEN_TRACES;
+            }
+        }
+    }
+
+    /// Only the first light to flush a frame is counted, so a fleet write
+    /// makes one sample, not one per port.
+    fn written(&mut self, frame: &CctFrame, now: Instant) {
+        let Some(slot) = self.find(frame) else {
+            return;
+        };
+        let open = slot.as_mut().unwrap();
+        if open.written.is_none() {
+            open.written = Some(now);
+            let d = now - open.entered;
+            self.record(Stage::CommandToWrite, d);
+        }
+    }
+
+    fn echoed(&mut self, packet: &[u8], now: Instant) {
+        let Some(slot) = self.find(packet) else {
+            return;
+        };
+        let Some(Open {
+            input,
+            written: Some(written),
+            ..
+        }) = slot.take()
+        else {
+            return;
+        };
+        self.record(Stage::WriteToEcho, now - written);
+        self.record(Stage::Total, now - input);
+    }
+
+    fn stats(&self) -> Vec<StageStats> {
+        STAGES
+            .iter()
+            .map(|&stage| {
+                let h = &self.stages[stage as usize];
+                StageStats {
+                    stage: stage.name(),
+                    count: h.total,
+                    p50_us: h.quantile(0.5),
+                    p99_us: h.quantile(0.99),
+                    max_us: h.max_us,
+                }
+            })
+            .collect()
+    }
+}
+
+/// Open a trace for `cct`, which `set_light` is about to submit.
+pub fn begin(cct: Cct, trace: Trace) {
+    let wall_ms = SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .unwrap_or_default()
+        .as_secs_f64()
+        * 1000.0;
+    let ms = |v: f64| Duration::from_secs_f64(v.max(0.0) / 1000.0);
+    update(|tracer, now| {
+        tracer.begin(
+            cct,
+            ms(trace.input_to_dispatch_ms),
+            ms(wall_ms - trace.dispatched_at_ms),
+            now,
+        )
+    });
+}
+
+/// Run `f` on the tracer and publish how many traces are left open.
+fn update(f: impl FnOnce(&mut Tracer, Instant)) {
+    let now = Instant::now();
+    let mut tracer = TRACER.lock().unwrap();
+    tracer.expire(now);
+    f(&mut tracer, now);
+    OPEN_COUNT.store(tracer.open_count(), Ordering::Release);
+}
+
+/// The writer has flushed `frame` to a port.
+pub fn written(frame: &CctFrame) {
+    if OPEN_COUNT.load(Ordering::Acquire) > 0 {
+        update(|tracer, now| tracer.written(frame, now));
+    }
+}
+
+/// The read loop has matched `packet` as the echo of one of our writes.
+pub fn echoed(packet: &[u8]) {
+    if OPEN_COUNT.load(Ordering::Acquire) > 0 {
+        update(|tracer, now| tracer.echoed(packet, now));
+    }
+}
+
+pub fn stats() -> Vec<StageStats> {
+    TRACER.lock().unwrap().stats()
+}
+
+pub fn reset() {
+    update(|tracer, _| *tracer = Tracer::new());
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::protocol;
+
+    #[test]
+    fn test_buckets_cover_their_values() {
+        let mut prev = 0;
+        for us in [0, 1, 7, 8, 9, 15, 16, 1000, 30_000, 1_000_000] {
+            let bucket = Histogram::bucket(us);
+            assert!(bucket >= prev);
+            assert!(Histogram::upper(bucket) >= us);
+            assert!(bucket == 0 || Histogram::upper(bucket - 1) < us);
+            prev = bucket;
+        }
+    }
+
+    #[test]
+    fn test_quantiles() {
+        let mut h = Histogram::new();
+        for ms in 1..=100 {
+            h.record(Duration::from_millis(ms));
+        }
+        let p50 = h.quantile(0.5);
+        assert!((50_000..=60_000).contains(&p50), "{p50}");
+        assert!(h.quantile(0.99) >= 99_000);
+        assert_eq!(h.quantile(1.0), 100_000);
+    }
+
+    #[test]
+    fn test_trace_records_every_stage_once() {
+        let mut tracer = Tracer::new();
+        let cct = Cct::new(50, 4950);
+        let frame = ModelKind::Pl81Pro.encode(cct);
+        let t0 = Instant::now();
+        let ms = Duration::from_millis;
+        tracer.begin(cct, ms(30), ms(2), t0 + ms(32));
+        tracer.written(&frame, t0 + ms(33));
+        tracer.written(&frame, t0 + ms(34));
+        tracer.echoed(&protocol::cct_command(51, 4950), t0 + ms(35));
+        tracer.echoed(&frame, t0 + ms(36));
+        tracer.echoed(&frame, t0 + ms(37));
+
+        let stats = tracer.stats();
+        assert!(stats.iter().all(|s| s.count == 1));
+        let total = stats.iter().find(|s| s.stage == "total").unwrap();
+        assert_eq!(total.max_us, 36_000);
+        assert_eq!(tracer.open_count(), 0);
+    }
+
+    #[test]
+    fn test_unfinished_traces_expire() {
+        let mut tracer = Tracer::new();
+        let t0 = Instant::now();
+        tracer.begin(Cct::new(50, 4950), Duration::ZERO, Duration::ZERO, t0);
+        tracer.expire(t0 + TRACE_TTL / 2);
+        assert_eq!(tracer.open_count(), 1);
+        tracer.expire(t0 + TRACE_TTL);
+        assert_eq!(tracer.open_count(), 0);
+    }
+}
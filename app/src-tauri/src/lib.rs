@@ -1,26 +1,80 @@
+pub mod capture;
 mod commands;
-mod protocol;
-mod serial;
+#[cfg(unix)]
+mod daemon;
+mod fleet;
+mod hotplug;
+mod latency;
+mod light_state;
+pub mod model;
+pub mod framing;
+pub mod protocol;
+pub mod serial;
+mod settings;
+mod shortcuts;
+pub mod timeline;
+mod transition;
+mod udp;
 
-use serial::SerialManager;
+use fleet::Fleet;
+use light_state::LightState;
+use settings::Settings;
+use transition::TransitionEngine;
 use tauri::{
     tray::{MouseButton, MouseButtonState, TrayIconBuilder, TrayIconEvent},
-    Manager,
+    AppHandle, Manager, RunEvent, WebviewUrl, WebviewWindow, WebviewWindowBuilder,
 };
 
+/// The menubar panel, created hidden on first use.
+fn panel_window(app: &AppHandle) -> tauri::Result<WebviewWindow> {
+    if let Some(win) = app.get_webview_window("panel") {
+        return Ok(win);
+    }
+    WebviewWindowBuilder::new(app, "panel", WebviewUrl::App("/".into()))
+        .visible(false)
+        .decorations(false)
+        .always_on_top(true)
+        .skip_taskbar(true)
+        .inner_size(320.0, 340.0)
+        .resizable(false)
+        .transparent(true)
+        .build()
+}
+
 #[cfg_attr(mobile, tauri::mobile_entry_point)]
 pub fn run() {
     let mut app = tauri::Builder::default()
         .plugin(tauri_plugin_positioner::init())
         .plugin(tauri_plugin_global_shortcut::Builder::new().build())
-        .plugin(tauri_plugin_store::Builder::new().build())
-        .manage(SerialManager::new())
+        .manage(Fleet::new())
+        .manage(TransitionEngine::new())
         .invoke_handler(tauri::generate_handler![
             commands::list_ports,
+            commands::list_lights,
             commands::connect,
             commands::disconnect,
             commands::is_connected,
             commands::set_light,
+            commands::set_light_group,
+            commands::set_light_group_synced,
+            commands::apply_scene,
+            commands::port_latencies,
+            commands::set_pipeline_window,
+            commands::latency_stats,
+            commands::reset_latency_stats,
+            commands::fade_to,
+            commands::play_timeline,
+            commands::stop_timeline,
+            commands::settings_get,
+            commands::settings_update,
+            commands::reload_shortcuts,
+            commands::conversion_tables,
+            commands::get_panel_state,
+            commands::set_panel_state,
+            commands::toggle_power,
+            commands::apply_preset,
+            commands::save_preset,
+            commands::delete_preset,
             commands::quit_app,
         ])
         .setup(|app| {
@@ -43,7 +97,7 @@ pub fn run() {
                     } = event
                     {
                         let app = tray.app_handle();
-                        if let Some(win) = app.get_webview_window("panel") {
+                        if let Ok(win) = panel_window(app) {
                             if win.is_visible().unwrap_or(false) {
                                 let _ = win.hide();
                             } else {
@@ -58,12 +112,31 @@ pub fn run() {
                 })
                 .build(app)?;
 
-            // Auto-connect to serial port on launch
+            // Settings are kept in memory and written behind
+            let path = app.path().app_data_dir()?.join("settings.json");
+            let settings = Settings::load(path);
+            app.manage(LightState::load(&settings));
+            app.manage(settings);
             let handle = app.handle().clone();
-            let serial = app.state::<SerialManager>();
-            if let Some(port) = SerialManager::find_port() {
-                let _ = serial.connect(&port, handle);
-            }
+            std::thread::spawn(move || handle.state::<Settings>().run_writer());
+
+            // Shortcuts work from launch; the panel webview is only created
+            // on the first tray click
+            let _ = shortcuts::register(app.handle());
+
+            // Opt-in serial capture, before any light connects
+            let _ = capture::start_from_env();
+
+            // Connect every attached light in the background, now and on
+            // each plug/unplug
+            hotplug::start(app.handle().clone());
+
+            // Local socket for scripts and the Python CLI
+            #[cfg(unix)]
+            let _ = daemon::start(app.handle().clone());
+
+            // Network endpoint for show control, if configured
+            let _ = udp::start(app.handle().clone());
 
             Ok(())
         })
@@ -73,5 +146,12 @@ pub fn run() {
     #[cfg(target_os = "macos")]
     app.set_activation_policy(tauri::ActivationPolicy::Accessory);
 
-    app.run(|_app_handle, _event| {});
+    app.run(|app_handle, event| {
+        if let RunEvent::Exit = event {
+            let _ = app_handle.state::<Settings>().flush();
+            capture::stop();
+            #[cfg(unix)]
+            daemon::stop();
+        }
+    });
 }
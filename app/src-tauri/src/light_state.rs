@@ -0,0 +1,367 @@
+/// The panel's light state — brightness, Kelvin, on/off, the last "on"
+/// brightness and the preset table — owned by the backend.
+///
+/// The panel, global shortcuts, knob turns and reconnects all go through
+/// here, so a hotkey reaches the serial writers without a webview round-trip
+/// and works before the panel has ever been opened. Changes that didn't come
+/// from the panel are emitted as "state-changed" for an open panel to mirror.
+/// Everything is persisted through `Settings` under the keys the panel used.
+use std::sync::{Mutex, MutexGuard};
+
+use serde::{Deserialize, Serialize};
+use serde_json::{Map, Value};
+use tauri::{AppHandle, Emitter, Manager};
+
+use crate::fleet::Fleet;
+use crate::latency::{self, Trace};
+use crate::protocol::Cct;
+use crate::serial::Priority;
+use crate::settings::Settings;
+use crate::shortcuts::{self, ShortcutConfig};
+use crate::transition::{self, TransitionEngine};
+
+pub const MAX_PRESETS: usize = 4;
+/// Key given to a new preset when the config doesn't have one for it yet.
+const DEFAULT_PRESET_KEYS: [&str; MAX_PRESETS] = ["1", "2", "3", "4"];
+
+#[derive(Debug, Clone, Copy, PartialEq, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct PanelState {
+    /// Slider position, 0-100.
+    pub brightness: f64,
+    pub kelvin: u32,
+    pub is_on: bool,
+}
+
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub struct Preset {
+    pub name: String,
+    pub brightness: f64,
+    pub kelvin: u32,
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct Snapshot {
+    #[serde(flatten)]
+    pub state: PanelState,
+    pub presets: Vec<Preset>,
+}
+
+/// Presets with the shortcut keys bound to them, index for index.
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct PresetTable {
+    pub presets: Vec<Preset>,
+    pub preset_keys: Vec<String>,
+}
+
+impl PanelState {
+    /// Hardware brightness: the slider through the gamma curve, zero while off.
+    pub fn hw_brightness(&self) -> u8 {
+        if self.is_on {
+            transition::slider_to_hw(self.brightness)
+        } else {
+            0
+        }
+    }
+
+    pub fn cct(&self) -> Cct {
+        Cct::new(self.hw_brightness(), self.kelvin)
+    }
+}
+
+struct Inner {
+    state: PanelState,
+    /// Brightness to come back to when toggled on.
+    last_on: f64,
+    presets: Vec<Preset>,
+}
+
+impl Inner {
+    fn set(&mut self, state: PanelState) {
+        self.state = state;
+        if state.is_on && state.brightness > 0.0 {
+            self.last_on = state.brightness;
+        }
+    }
+
+    fn toggle(&mut self) {
+        let mut state = self.state;
+        state.is_on = !state.is_on;
+        if state.is_on {
+            state.brightness = self.last_on;
+        }
+        self.set(state);
+    }
+
+    fn snapshot(&self) -> Snapshot {
+        Snapshot {
+            state: self.state,
+            presets: self.presets.clone(),
+        }
+    }
+}
+
+pub struct LightState {
+    inner: Mutex<Inner>,
+}
+
+impl LightState {
+    /// Saved state, with the panel's defaults for anything missing.
+    pub fn load(settings: &Settings) -> Self {
+        let state = PanelState {
+            brightness: settings.get("brightness").unwrap_or(100.0),
+            kelvin: settings.get("kelvin").unwrap_or(4950),
+            is_on: settings.get("isOn").unwrap_or(true),
+        };
+        Self {
+            inner: Mutex::new(Inner {
+                state,
+                last_on: if state.brightness > 0.0 {
+                    state.brightness
+                } else {
+                    100.0
+                },
+                presets: settings.get("presets").unwrap_or_default(),
+            }),
+        }
+    }
+
+    pub fn snapshot(&self) -> Snapshot {
+        self.lock().snapshot()
+    }
+
+    /// A change made on the panel: persisted and sent, not echoed back.
+    pub fn set(
+        &self,
+        app: &AppHandle,
+        state: PanelState,
+        trace: Option<Trace>,
+    ) -> Result<(), String> {
+        let mut inner = self.lock();
+        let priority = power_change(&inner, state);
+        inner.set(state);
+        send(app, &inner, priority, trace)
+    }
+
+    /// A change from outside the panel (the local socket): sent, and
+    /// announced for the panel to mirror even if no light took it.
+    #[cfg(unix)]
+    pub fn apply(&self, app: &AppHandle, state: PanelState) -> Result<Snapshot, String> {
+        let mut inner = self.lock();
+        let priority = power_change(&inner, state);
+        inner.set(state);
+        let sent = send(app, &inner, priority, None);
+        let snapshot = announce(app, &inner);
+        sent.map(|_| snapshot)
+    }
+
+    pub fn toggle(&self, app: &AppHandle) -> Snapshot {
+        let mut inner = self.lock();
+        inner.toggle();
+        let _ = send(app, &inner, Priority::Power, None);
+        announce(app, &inner)
+    }
+
+    pub fn apply_preset(&self, app: &AppHandle, index: usize) -> Result<Snapshot, String> {
+        let mut inner = self.lock();
+        let preset = inner
+            .presets
+            .get(index)
+            .ok_or_else(|| format!("No preset {}", index + 1))?;
+        let state = PanelState {
+            brightness: preset.brightness,
+            kelvin: preset.kelvin,
+            is_on: true,
+        };
+        inner.set(state);
+        let _ = send_changed(app, &inner);
+        Ok(announce(app, &inner))
+    }
+
+    /// Record a state the light is already in (a knob turn, or the end
+    /// point of a fade) without sending anything.
+    pub fn record(&self, app: &AppHandle, state: PanelState) {
+        let mut inner = self.lock();
+        inner.set(state);
+        persist_state(app, &inner);
+    }
+
+    /// Save the current brightness and Kelvin as a new preset, binding the
+    /// next free shortcut key to it.
+    pub fn save_preset(&self, app: &AppHandle) -> Result<PresetTable, String> {
+        let table = {
+            let mut inner = self.lock();
+            if inner.presets.len() >= MAX_PRESETS {
+                return Err(format!("At most {MAX_PRESETS} presets"));
+            }
+            let n = inner.presets.len();
+            let state = inner.state;
+            inner.presets.push(Preset {
+                name: format!("Preset {}", n + 1),
+                brightness: state.brightness,
+                kelvin: state.kelvin,
+            });
+            let settings = app.state::<Settings>();
+            let mut config = ShortcutConfig::load(&settings);
+            if config.preset_keys.len() <= n {
+                let key = DEFAULT_PRESET_KEYS
+                    .get(n)
+                    .map_or_else(|| (n + 1).to_string(), |k| k.to_string());
+                config.preset_keys.push(key);
+            }
+            persist_presets(&settings, &inner.presets, &config)
+        };
+        let _ = shortcuts::register(app);
+        Ok(table)
+    }
+
+    pub fn delete_preset(&self, app: &AppHandle, index: usize) -> Result<PresetTable, String> {
+        let table = {
+            let mut inner = self.lock();
+            if index >= inner.presets.len() {
+                return Err(format!("No preset {}", index + 1));
+            }
+            inner.presets.remove(index);
+            let settings = app.state::<Settings>();
+            let mut config = ShortcutConfig::load(&settings);
+            if index < config.preset_keys.len() {
+                config.preset_keys.remove(index);
+            }
+            persist_presets(&settings, &inner.presets, &config)
+        };
+        let _ = shortcuts::register(app);
+        Ok(table)
+    }
+
+    /// Send the current state to a light that has just connected.
+    pub fn restore(&self, app: &AppHandle, id: &str) {
+        let cct = self.lock().state.cct();
+        let _ = app
+            .state::<Fleet>()
+            .submit_group(&[id.to_string()], cct, Priority::Interactive);
+    }
+
+    fn lock(&self) -> MutexGuard<'_, Inner> {
+        self.inner.lock().unwrap()
+    }
+}
+
+/// Persist and send the current state. Sent while the state lock is held,
+/// so concurrent changes reach the writers in the order they were made.
+fn send(
+    app: &AppHandle,
+    inner: &Inner,
+    priority: Priority,
+    trace: Option<Trace>,
+) -> Result<(), String> {
+    persist_state(app, inner);
+    let state = inner.state;
+    app.state::<TransitionEngine>()
+        .set(state.hw_brightness(), state.kelvin);
+    let cct = state.cct();
+    if let Some(trace) = trace {
+        latency::begin(cct, trace);
+    }
+    app.state::<Fleet>().submit_all(cct, priority)
+}
+
+/// Switching a light on or off outranks any other change.
+fn power_change(inner: &Inner, state: PanelState) -> Priority {
+    if state.is_on != inner.state.is_on {
+        Priority::Power
+    } else {
+        Priority::Interactive
+    }
+}
+
+/// Like `send`, but only to lights not already in this state (preset recall).
+fn send_changed(app: &AppHandle, inner: &Inner) -> Result<usize, String> {
+    persist_state(app, inner);
+    let state = inner.state;
+    app.state::<TransitionEngine>()
+        .set(state.hw_brightness(), state.kelvin);
+    app.state::<Fleet>().submit_all_changed(state.cct())
+}
+
+fn announce(app: &AppHandle, inner: &Inner) -> Snapshot {
+    let snapshot = inner.snapshot();
+    let _ = app.emit("state-changed", &snapshot);
+    snapshot
+}
+
+fn persist_state(app: &AppHandle, inner: &Inner) {
+    let mut patch = Map::new();
+    patch.insert("brightness".into(), Value::from(inner.state.brightness));
+    patch.insert("kelvin".into(), Value::from(inner.state.kelvin));
+    patch.insert("isOn".into(), Value::from(inner.state.is_on));
+    app.state::<Settings>().update(patch);
+}
+
+fn persist_presets(
+    settings: &Settings,
+    presets: &[Preset],
+    config: &ShortcutConfig,
+) -> PresetTable {
+    let mut patch = Map::new();
+    patch.insert("presets".into(), serde_json::to_value(presets).unwrap());
+    patch.insert(
+        "shortcutConfig".into(),
+        serde_json::to_value(config).unwrap(),
+    );
+    settings.update(patch);
+    PresetTable {
+        presets: presets.to_vec(),
+        preset_keys: config.preset_keys.clone(),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn inner(brightness: f64, is_on: bool) -> Inner {
+        Inner {
+            state: PanelState {
+                brightness,
+                kelvin: 4950,
+                is_on,
+            },
+            last_on: 100.0,
+            presets: Vec::new(),
+        }
+    }
+
+    #[test]
+    fn test_toggle_restores_last_on_brightness() {
+        let mut inner = inner(60.0, true);
+        inner.set(PanelState {
+            brightness: 40.0,
+            ..inner.state
+        });
+        inner.toggle();
+        assert!(!inner.state.is_on);
+        assert_eq!(inner.state.cct(), Cct::new(0, 4950));
+        inner.toggle();
+        assert!(inner.state.is_on);
+        assert_eq!(inner.state.brightness, 40.0);
+    }
+
+    #[test]
+    fn test_knob_to_zero_keeps_last_on() {
+        let mut inner = inner(60.0, true);
+        inner.set(PanelState {
+            brightness: 60.0,
+            ..inner.state
+        });
+        // The light reports zero brightness after its knob is turned down.
+        inner.set(PanelState {
+            brightness: 0.0,
+            kelvin: 4950,
+            is_on: false,
+        });
+        inner.toggle();
+        assert_eq!(inner.state.brightness, 60.0);
+        assert!(inner.state.is_on);
+    }
+}
@@ -0,0 +1,136 @@
+/// Light models: temperature ranges and step encodings.
+///
+/// Each model is a zero-sized type implementing `Model`, and the encoders
+/// are generic over it, so every model gets its own specialized copy with
+/// its constants folded in. A fleet keeps one `ModelKind` per light, and a
+/// `match` on it per frame picks the specialized encoder; there are no
+/// trait objects.
+///
+/// Only the PL81-Pro is known over USB so far. Another model is added here,
+/// with a `fleet::USB_MODELS` entry, once a capture of it has been taken.
+///
+/// The rest of the app speaks `protocol::Cct`, brightness and Kelvin. Each
+/// light's link quantizes that once, for its model, with `encode`, and
+/// reads that model's echoes and status with `decode`.
+use serde::Serialize;
+
+use crate::protocol::{self, Cct, CctFrame};
+
+pub trait Model {
+    const NAME: &'static str;
+    const TEMP_MIN_K: u32;
+    const TEMP_MAX_K: u32;
+    /// Temperature steps above the warmest, which is `TEMP_BASE`.
+    const TEMP_STEPS: u32;
+    const TEMP_BASE: u8;
+}
+
+/// Neewer PL81-Pro: bi-color, 0x00 = 2900K to 0x12 = 7000K (calibrated).
+pub struct Pl81Pro;
+
+impl Model for Pl81Pro {
+    const NAME: &'static str = "PL81-Pro";
+    const TEMP_MIN_K: u32 = protocol::TEMP_MIN_K;
+    const TEMP_MAX_K: u32 = protocol::TEMP_MAX_K;
+    const TEMP_STEPS: u32 = protocol::TEMP_STEPS;
+    const TEMP_BASE: u8 = 0x00;
+}
+
+/// Kelvin to `M`'s temperature byte, rounding to the nearest step.
+pub const fn kelvin_to_byte<M: Model>(kelvin: u32) -> u8 {
+    let k = if kelvin < M::TEMP_MIN_K {
+        M::TEMP_MIN_K
+    } else if kelvin > M::TEMP_MAX_K {
+        M::TEMP_MAX_K
+    } else {
+        kelvin
+    };
+    let span = M::TEMP_MAX_K - M::TEMP_MIN_K;
+    M::TEMP_BASE + (((k - M::TEMP_MIN_K) * M::TEMP_STEPS + span / 2) / span) as u8
+}
+
+/// `M`'s temperature byte to Kelvin; bytes outside the range clamp to it.
+pub const fn byte_to_kelvin<M: Model>(b: u8) -> u32 {
+    let step = if b < M::TEMP_BASE {
+        0
+    } else if (b - M::TEMP_BASE) as u32 > M::TEMP_STEPS {
+        M::TEMP_STEPS
+    } else {
+        (b - M::TEMP_BASE) as u32
+    };
+    let span = step * (M::TEMP_MAX_K - M::TEMP_MIN_K);
+    M::TEMP_MIN_K + (span + M::TEMP_STEPS / 2) / M::TEMP_STEPS
+}
+
+/// CCT command for `M`: brightness 0-100, temperature in Kelvin.
+pub const fn cct_command<M: Model>(brightness: u8, kelvin: u32) -> CctFrame {
+    protocol::cct_command_raw(brightness, kelvin_to_byte::<M>(kelvin))
+}
+
+/// Brightness and Kelvin from one of `M`'s CCT status or echo packets.
+pub fn parse_status<M: Model>(packet: &[u8]) -> Option<(u8, u32)> {
+    protocol::parse_status(packet).map(|(bri, temp)| (bri, byte_to_kelvin::<M>(temp)))
+}
+
+/// The model of one light, chosen from its USB identity.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum ModelKind {
+    #[default]
+    Pl81Pro,
+}
+
+impl ModelKind {
+    pub const ALL: [ModelKind; 1] = [ModelKind::Pl81Pro];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            ModelKind::Pl81Pro => Pl81Pro::NAME,
+        }
+    }
+
+    /// This light's frame for `cct`.
+    pub fn encode(self, cct: Cct) -> CctFrame {
+        match self {
+            ModelKind::Pl81Pro => cct_command::<Pl81Pro>(cct.brightness, cct.kelvin),
+        }
+    }
+
+    /// Brightness and Kelvin from a packet this light sent.
+    pub fn decode(self, packet: &[u8]) -> Option<(u8, u32)> {
+        match self {
+            ModelKind::Pl81Pro => parse_status::<Pl81Pro>(packet),
+        }
+    }
+}
+
+impl Serialize for ModelKind {
+    fn serialize<S: serde::Serializer>(&self, serializer: S) -> Result<S::Ok, S::Error> {
+        serializer.serialize_str(self.name())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_pl81_pro_matches_protocol() {
+        for k in 0..10_000 {
+            assert_eq!(cct_command::<Pl81Pro>(50, k), protocol::cct_command(50, k));
+        }
+        for b in 0..=0x40 {
+            assert_eq!(byte_to_kelvin::<Pl81Pro>(b), protocol::byte_to_kelvin(b));
+        }
+    }
+
+    #[test]
+    fn test_encode_round_trips_through_model() {
+        let kind = ModelKind::Pl81Pro;
+        let sent = kind.encode(Cct::new(80, 4950));
+        assert_eq!(sent, protocol::cct_command(80, 4950));
+        // The echo reads back in Kelvin, within one of the model's steps.
+        let (bri, kelvin) = kind.decode(&sent).unwrap();
+        assert_eq!(bri, 80);
+        assert!(kelvin.abs_diff(4950) <= 120);
+    }
+}
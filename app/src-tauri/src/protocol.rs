@@ -2,47 +2,151 @@
 ///
 /// Command format: [0x3A] [tag] [payload_len] [payload...] [cs_hi] [cs_lo]
 /// Checksum: 16-bit big-endian sum of all preceding bytes.
+///
+/// Other models' ranges and encodings are in `model`.
+use crate::model::{self, Pl81Pro};
 
 pub const TEMP_MIN_K: u32 = 2900;
 pub const TEMP_MAX_K: u32 = 7000;
 pub const TEMP_STEPS: u32 = 18; // 0x00 = 2900K, 0x12 = 7000K
 
 /// 16-bit big-endian checksum of all bytes.
-fn checksum(data: &[u8]) -> [u8; 2] {
-    let s: u16 = data.iter().map(|&b| b as u16).sum();
-    [(s >> 8) as u8, (s & 0xFF) as u8]
+pub const fn checksum(data: &[u8]) -> [u8; 2] {
+    let mut s: u16 = 0;
+    let mut i = 0;
+    while i < data.len() {
+        s = s.wrapping_add(data[i] as u16);
+        i += 1;
+    }
+    s.to_be_bytes()
+}
+
+/// A complete command packet of `N` bytes, checksum included.
+///
+/// Lives on the stack and derefs to `&[u8]`, so building and sending a
+/// command never allocates.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Frame<const N: usize>([u8; N]);
+
+/// CCT packets are always 8 bytes.
+pub type CctFrame = Frame<8>;
+
+impl<const N: usize> Frame<N> {
+    /// Seal a packet: the last two bytes are overwritten with the checksum
+    /// of everything before them.
+    pub const fn seal(mut bytes: [u8; N]) -> Self {
+        let mut s: u16 = 0;
+        let mut i = 0;
+        while i < N - 2 {
+            s = s.wrapping_add(bytes[i] as u16);
+            i += 1;
+        }
+        let cs = s.to_be_bytes();
+        bytes[N - 2] = cs[0];
+        bytes[N - 1] = cs[1];
+        Self(bytes)
+    }
+
+    pub const fn as_bytes(&self) -> &[u8; N] {
+        &self.0
+    }
+}
+
+impl<const N: usize> std::ops::Deref for Frame<N> {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        &self.0
+    }
+}
+
+impl<const N: usize> AsRef<[u8]> for Frame<N> {
+    fn as_ref(&self) -> &[u8] {
+        &self.0
+    }
+}
+
+/// A CCT state before any model has encoded it: brightness 0-100 and
+/// temperature in Kelvin. This is what the app hands to a light's link,
+/// which quantizes it once, for that light's model.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Cct {
+    pub brightness: u8,
+    pub kelvin: u32,
 }
 
-/// Build a complete command packet with checksum.
-fn build_packet(payload: &[u8]) -> Vec<u8> {
-    let cs = checksum(payload);
-    let mut pkt = payload.to_vec();
-    pkt.extend_from_slice(&cs);
-    pkt
+impl Cct {
+    pub const fn new(brightness: u8, kelvin: u32) -> Self {
+        Self { brightness, kelvin }
+    }
 }
 
 /// Build a CCT command: brightness 0-100, temperature in Kelvin.
-pub fn cct_command(brightness: u8, kelvin: u32) -> Vec<u8> {
-    let bri = brightness.min(100);
-    let temp = kelvin_to_byte(kelvin);
-    build_packet(&[0x3A, 0x02, 0x03, 0x01, bri, temp])
+pub const fn cct_command(brightness: u8, kelvin: u32) -> CctFrame {
+    cct_command_raw(brightness, kelvin_to_byte(kelvin))
+}
+
+/// Build a CCT command from an already-quantized temperature byte.
+pub const fn cct_command_raw(brightness: u8, temp_byte: u8) -> CctFrame {
+    let bri = if brightness > 100 { 100 } else { brightness };
+    Frame::seal([0x3A, 0x02, 0x03, 0x01, bri, temp_byte, 0, 0])
+}
+
+/// Build a power command (tag 0x06). Decoded from the app binary; the
+/// PL81-Pro accepts it without changing state.
+pub const fn power_command(on: bool) -> Frame<6> {
+    Frame::seal([0x3A, 0x06, 0x01, if on { 0x01 } else { 0x02 }, 0, 0])
+}
+
+/// Build an HSI command (tag 0x04): hue 0-360, saturation and brightness 0-100.
+pub const fn hsi_command(hue: u16, saturation: u8, brightness: u8) -> Frame<9> {
+    let hue = if hue > 360 { 360 } else { hue };
+    let sat = if saturation > 100 { 100 } else { saturation };
+    let bri = if brightness > 100 { 100 } else { brightness };
+    Frame::seal([
+        0x3A,
+        0x04,
+        0x04,
+        (hue & 0xFF) as u8,
+        (hue >> 8) as u8,
+        sat,
+        bri,
+        0,
+        0,
+    ])
 }
 
+/// Kelvin of each temperature byte, 0x00-0x12.
+pub const KELVIN_STEPS: [u32; TEMP_STEPS as usize + 1] = {
+    let mut table = [0; TEMP_STEPS as usize + 1];
+    let mut b = 0;
+    while b < table.len() {
+        let span = (b as u32) * (TEMP_MAX_K - TEMP_MIN_K);
+        table[b] = TEMP_MIN_K + (span + TEMP_STEPS / 2) / TEMP_STEPS;
+        b += 1;
+    }
+    table
+};
+
 /// Convert Kelvin (2900-7000) to protocol byte (0x00-0x12).
-pub fn kelvin_to_byte(kelvin: u32) -> u8 {
-    let k = kelvin.clamp(TEMP_MIN_K, TEMP_MAX_K);
-    let step = ((k - TEMP_MIN_K) as f64 * TEMP_STEPS as f64 / (TEMP_MAX_K - TEMP_MIN_K) as f64)
-        .round() as u8;
-    step.min(TEMP_STEPS as u8)
+///
+/// Rounds to the nearest step in integer arithmetic, halves up, which is what
+/// the float `round` gave for every Kelvin value.
+pub const fn kelvin_to_byte(kelvin: u32) -> u8 {
+    model::kelvin_to_byte::<Pl81Pro>(kelvin)
 }
 
 /// Convert protocol byte (0x00-0x12) to Kelvin.
-pub fn byte_to_kelvin(b: u8) -> u32 {
-    let b = (b as u32).min(TEMP_STEPS);
-    TEMP_MIN_K + (b * (TEMP_MAX_K - TEMP_MIN_K) + TEMP_STEPS / 2) / TEMP_STEPS
+pub const fn byte_to_kelvin(b: u8) -> u32 {
+    let b = if b as u32 > TEMP_STEPS {
+        TEMP_STEPS
+    } else {
+        b as u32
+    };
+    KELVIN_STEPS[b as usize]
 }
 
-/// Parse an 8-byte status/echo packet. Returns (brightness, temp_byte) or None.
+/// Parse an 8-byte CCT status/echo packet. Returns (brightness, temp_byte) or None.
 pub fn parse_status(data: &[u8]) -> Option<(u8, u8)> {
     if data.len() >= 8 && data[0] == 0x3A && data[1] == 0x02 {
         let expected = checksum(&data[..6]);
@@ -72,6 +176,22 @@ mod tests {
         assert_eq!(cmd.len(), 8);
     }
 
+    #[test]
+    fn test_power_and_hsi_commands() {
+        assert_eq!(
+            power_command(true).as_bytes(),
+            &[0x3A, 0x06, 0x01, 0x01, 0x00, 0x42]
+        );
+        assert_eq!(
+            power_command(false).as_bytes(),
+            &[0x3A, 0x06, 0x01, 0x02, 0x00, 0x43]
+        );
+        // hue 300 = 0x012C → lo 0x2C, hi 0x01
+        let cmd = hsi_command(300, 100, 50);
+        assert_eq!(&cmd[..7], &[0x3A, 0x04, 0x04, 0x2C, 0x01, 0x64, 0x32]);
+        assert_eq!(&cmd[7..], &checksum(&cmd[..7]));
+    }
+
     #[test]
     fn test_kelvin_roundtrip() {
         assert_eq!(kelvin_to_byte(2900), 0);
@@ -82,6 +202,19 @@ mod tests {
         assert_eq!(kelvin_to_byte(4950), 9);
     }
 
+    #[test]
+    fn test_integer_kelvin_matches_float() {
+        let span = (TEMP_MAX_K - TEMP_MIN_K) as f64;
+        for k in 0..10_000 {
+            let c = k.clamp(TEMP_MIN_K, TEMP_MAX_K);
+            let step = ((c - TEMP_MIN_K) as f64 * TEMP_STEPS as f64 / span).round() as u8;
+            assert_eq!(kelvin_to_byte(k), step, "{k}K");
+        }
+        for b in 0..=TEMP_STEPS as u8 {
+            assert_eq!(kelvin_to_byte(byte_to_kelvin(b)), b);
+        }
+    }
+
     #[test]
     fn test_parse_status() {
         let pkt = cct_command(50, 4950);
@@ -2,141 +2,1488 @@
 ///
 /// Handles port discovery, connection, read loop, and write commands.
 /// Emits "light-status" events to the frontend when status packets arrive.
-use std::io::Read;
+///
+/// Light state changes go through a single-slot mailbox drained by a
+/// writer task, so callers never block on the serial line and a burst of
+/// slider updates collapses to the newest state. The writer pipelines a
+/// small window of frames and the read loop matches the light's echoes
+/// against them, which confirms delivery and keeps echoes out of the
+/// "light-status" events: those only report changes made on the light.
+///
+/// Each connection is a reader task and a writer task on the app's async
+/// runtime, so one executor serves the whole fleet. The reader is woken by
+/// the OS when bytes arrive or when the connection is closed, and nothing
+/// runs while the light is idle. What the reader learns goes to a
+/// `LinkEvents` sink: the app in production, a counter in the stress harness.
+///
+/// While a capture runs (`capture`), both tasks record the raw bytes they
+/// move, so malformed input the framer skips is kept for replay.
+use std::collections::VecDeque;
 use std::sync::{
-    atomic::{AtomicBool, Ordering},
+    atomic::{AtomicBool, AtomicU32, AtomicU64, AtomicUsize, Ordering},
     Arc, Mutex,
 };
-use std::time::Duration;
+use std::time::{Duration, Instant};
 
 use serde::Serialize;
-use tauri::{AppHandle, Emitter};
+use tauri::{AppHandle, Emitter, Manager};
+use tokio::io::{AsyncReadExt, AsyncWriteExt, ReadHalf, WriteHalf};
+use tokio::sync::Notify;
+use tokio_serial::{SerialPortBuilderExt, SerialStream};
+
+use crate::capture::{self, Tap};
+use crate::framing::Framer;
+use crate::latency;
+use crate::light_state::{LightState, PanelState};
+use crate::model::ModelKind;
+use crate::protocol::{Cct, CctFrame};
+use crate::transition;
+
+/// Where a connection reports what it reads.
+pub trait LinkEvents: Send + Sync + 'static {
+    /// A change made on the light itself, already rate limited.
+    fn status(&self, status: LightStatus);
+    /// The port went away under the read loop.
+    fn disconnected(&self, id: &str);
+}
+
+/// The app: status goes to the panel and becomes its state too.
+impl LinkEvents for AppHandle {
+    fn status(&self, status: LightStatus) {
+        let _ = self.emit("light-status", &status);
+        self.state::<LightState>().record(
+            self,
+            PanelState {
+                brightness: transition::hw_to_slider(status.brightness),
+                kelvin: status.kelvin,
+                is_on: status.brightness > 0,
+            },
+        );
+    }
 
-use crate::protocol;
+    fn disconnected(&self, id: &str) {
+        let _ = self.emit("serial-disconnected", id);
+    }
+}
 
 #[derive(Debug, Clone, Serialize)]
 pub struct LightStatus {
+    /// Fleet id of the light that sent the packet.
+    pub id: String,
     pub brightness: u8,
     pub kelvin: u32,
 }
 
-pub struct SerialManager {
-    port: Mutex<Option<Box<dyn serialport::SerialPort>>>,
-    reading: Arc<AtomicBool>,
+/// Frames allowed on the wire without an echo, unless configured otherwise.
+pub const DEFAULT_WINDOW: usize = 4;
+/// Upper bound for the in-flight window; the queue is allocated at this size.
+pub const MAX_WINDOW: usize = 16;
+/// Sends per frame before it is given up, the first one included.
+const MAX_ATTEMPTS: u8 = 3;
+/// Echo timeout until the round-trip has been measured.
+const DEFAULT_ACK_TIMEOUT: Duration = Duration::from_millis(250);
+const MIN_ACK_TIMEOUT: Duration = Duration::from_millis(20);
+const MAX_ACK_TIMEOUT: Duration = Duration::from_millis(500);
+/// Gap between sends on a fresh link: one fade step.
+const INITIAL_SEND_INTERVAL: Duration = transition::STEP_INTERVAL;
+/// The line itself can't carry frames any closer than this.
+const MIN_SEND_INTERVAL: Duration = transition::FRAME_TIME;
+const MAX_SEND_INTERVAL: Duration = Duration::from_millis(100);
+/// How much each clean echo shortens the gap.
+const SEND_INTERVAL_STEP: Duration = Duration::from_micros(100);
+/// Background frames are held back this long after a foreground post, so a
+/// manual change shows before the next fade step replaces it.
+const BACKGROUND_HOLD: Duration = Duration::from_millis(10);
+
+/// Scheduling class of a frame, lowest first.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+pub enum Priority {
+    /// Fades and timelines: paced, and never displaces a foreground frame.
+    Background,
+    /// Panel, shortcuts, scripts: jumps the queue, held back only as far as
+    /// the line itself needs.
+    Interactive,
+    /// Turning a light on or off: like `Interactive`, with a window slot
+    /// kept free for it.
+    Power,
 }
 
-impl SerialManager {
-    pub fn new() -> Self {
+impl Priority {
+    /// Frames of this class allowed in flight before it has to wait.
+    fn window(self, window: usize) -> usize {
+        match self {
+            Priority::Background | Priority::Interactive => window,
+            Priority::Power => window + 1,
+        }
+    }
+}
+
+/// Latest-value-wins handoff between command handlers and the writer task,
+/// plus the window of sent frames still waiting for their echo.
+///
+/// Holds at most one pending frame. Posting replaces whatever is waiting, so
+/// the writer only ever sends the newest state. The writer keeps up to
+/// `window` frames on the wire; each echo read back frees a place. A frame
+/// whose echo never arrives is resent only while it is still the newest
+/// state, since anything older has been superseded anyway.
+///
+/// Foreground frames (`Priority` above background) preempt: they replace a
+/// pending background frame and go out as soon as the window and the line
+/// allow, without waiting out the learned send gap, so a manual change
+/// isn't stuck behind a fade. Background posts can't replace them; they wait
+/// their turn, and only the newest of them is kept.
+struct Mailbox {
+    slot: Mutex<Slot>,
+    ready: Notify,
+    stats: Arc<LinkStats>,
+}
+
+struct Slot {
+    pending: Option<Pending>,
+    /// Newest background frame waiting for the foreground frame ahead of it
+    /// and the hold after it. Dropped by the next foreground post.
+    deferred: Option<Pending>,
+    /// Sent frames in send order. The light echoes in order, so an echo also
+    /// settles every frame sent before it.
+    in_flight: VecDeque<InFlight>,
+    /// Frames given up on, with when, so an echo that still turns up is
+    /// known for ours rather than taken for a knob report.
+    given_up: VecDeque<(CctFrame, Instant)>,
+    window: usize,
+    pacer: Pacer,
+    /// Hold background frames back until then (`BACKGROUND_HOLD`).
+    quiet_until: Option<Instant>,
+    open: bool,
+}
+
+#[derive(Clone, Copy)]
+struct Pending {
+    frame: CctFrame,
+    /// Hold the frame back until this instant (synchronized group writes).
+    not_before: Option<Instant>,
+    priority: Priority,
+}
+
+#[derive(Clone, Copy)]
+struct InFlight {
+    frame: CctFrame,
+    sent_at: Instant,
+    attempts: u8,
+}
+
+/// Send-rate control: the writer learns how fast the light's firmware keeps
+/// up. Like TCP congestion control, each clean echo shortens the gap between
+/// sends a little and each loss doubles it, so the rate settles just under
+/// what the light sustains. Posts arriving faster simply coalesce.
+struct Pacer {
+    interval: Duration,
+    last_sent: Option<Instant>,
+}
+
+impl Pacer {
+    fn new() -> Self {
         Self {
-            port: Mutex::new(None),
-            reading: Arc::new(AtomicBool::new(false)),
+            interval: INITIAL_SEND_INTERVAL,
+            last_sent: None,
         }
     }
 
-    /// Find the first matching USB serial port.
-    pub fn find_port() -> Option<String> {
-        serialport::available_ports()
-            .ok()?
-            .into_iter()
-            .find(|p| p.port_name.contains("usbserial"))
-            .map(|p| p.port_name)
+    /// Earliest instant the next frame of class `priority` may go out.
+    /// Only background traffic waits for the learned gap; foreground frames
+    /// still keep the line's own minimum.
+    fn ready_at(&self, priority: Priority) -> Option<Instant> {
+        let gap = match priority {
+            Priority::Background => self.interval,
+            Priority::Interactive | Priority::Power => MIN_SEND_INTERVAL,
+        };
+        self.last_sent.map(|at| at + gap)
     }
 
-    /// Open the serial port and start the read loop.
-    pub fn connect(&self, path: &str, app: AppHandle) -> Result<(), String> {
-        // Stop any existing read loop
-        self.reading.store(false, Ordering::Relaxed);
+    fn echoed(&mut self, stats: &LinkStats) {
+        self.interval = self
+            .interval
+            .saturating_sub(SEND_INTERVAL_STEP)
+            .max(MIN_SEND_INTERVAL);
+        stats.publish_interval(self.interval);
+    }
 
-        let port = serialport::new(path, 115200)
-            .data_bits(serialport::DataBits::Eight)
-            .parity(serialport::Parity::None)
-            .stop_bits(serialport::StopBits::One)
-            .timeout(Duration::from_millis(100))
-            .open()
-            .map_err(|e| format!("Failed to open {path}: {e}"))?;
+    fn lost(&mut self, stats: &LinkStats) {
+        self.interval = (self.interval * 2).min(MAX_SEND_INTERVAL);
+        stats.publish_interval(self.interval);
+    }
+}
+
+impl Slot {
+    /// Make `pending` the frame to send next. Background traffic that a
+    /// foreground frame takes precedence over is deferred until that frame
+    /// and its hold are done; background traffic already on its way is
+    /// dropped, since fades step in Kelvin, finer than a light's temperature
+    /// steps. Returns whether it was taken.
+    fn post(&mut self, pending: Pending, now: Instant) -> bool {
+        if pending.priority > Priority::Background {
+            self.quiet_until = Some(now + BACKGROUND_HOLD);
+            // Anything deferred predates this change.
+            self.deferred = None;
+            self.pending = Some(pending);
+            return true;
+        }
+        let newest = match self.deferred.or(self.pending) {
+            Some(p) => Some(p.frame),
+            None => self.in_flight.back().map(|f| f.frame),
+        };
+        if newest == Some(pending.frame) {
+            return false;
+        }
+        let held = self.quiet_until.is_some_and(|until| now < until);
+        let foreground = self
+            .pending
+            .is_some_and(|p| p.priority > Priority::Background);
+        if held || foreground {
+            self.deferred = Some(pending);
+        } else {
+            self.pending = Some(pending);
+        }
+        true
+    }
+
+    /// Resend or give up frames whose echo is overdue. Returns a frame to
+    /// resend, if any.
+    fn expire(&mut self, now: Instant, timeout: Duration, stats: &LinkStats) -> Option<CctFrame> {
+        // One back-off per pass, however many frames time out together.
+        if self
+            .in_flight
+            .front()
+            .is_some_and(|f| now >= f.sent_at + timeout)
+        {
+            self.pacer.lost(stats);
+        }
+        while let Some(oldest) = self.in_flight.front() {
+            if now < oldest.sent_at + timeout {
+                break;
+            }
+            let mut entry = self.in_flight.pop_front().unwrap();
+            let newest =
+                self.in_flight.is_empty() && self.pending.is_none() && self.deferred.is_none();
+            if newest && entry.attempts < MAX_ATTEMPTS {
+                entry.attempts += 1;
+                entry.sent_at = now;
+                self.pacer.last_sent = Some(now);
+                self.in_flight.push_back(entry);
+                stats.retries.fetch_add(1, Ordering::Relaxed);
+                return Some(entry.frame);
+            }
+            if self.given_up.len() == MAX_WINDOW {
+                self.given_up.pop_front();
+            }
+            self.given_up.push_back((entry.frame, now));
+            stats.lost.fetch_add(1, Ordering::Relaxed);
+        }
+        None
+    }
+
+    /// Move the pending frame onto the wire if it is due, the window has room
+    /// for its class and the pacer allows another send. Returns the frame to
+    /// send, if any.
+    fn dispatch(&mut self, now: Instant) -> Option<CctFrame> {
+        if self.pending.is_none() {
+            // Its turn has come; it still waits out the hold.
+            self.pending = self.deferred.take().map(|p| Pending {
+                not_before: p.not_before.max(self.quiet_until),
+                ..p
+            });
+        }
+        let pending = self.pending?;
+        if pending.not_before.is_some_and(|due| due > now) {
+            return None;
+        }
+        // Already on the wire and not yet echoed: nothing new to say.
+        if self
+            .in_flight
+            .back()
+            .is_some_and(|f| f.frame == pending.frame)
+        {
+            self.pending = None;
+            return self.dispatch(now);
+        }
+        if self.in_flight.len() >= pending.priority.window(self.window) {
+            return None;
+        }
+        if self
+            .pacer
+            .ready_at(pending.priority)
+            .is_some_and(|at| at > now)
+        {
+            return None;
+        }
+        self.pending = None;
+        self.pacer.last_sent = Some(now);
+        self.in_flight.push_back(InFlight {
+            frame: pending.frame,
+            sent_at: now,
+            attempts: 1,
+        });
+        Some(pending.frame)
+    }
+
+    /// Earliest instant at which `expire` or `dispatch` could make progress.
+    fn next_deadline(&self, timeout: Duration) -> Option<Instant> {
+        let ack = self.in_flight.front().map(|f| f.sent_at + timeout);
+        let due = match self.pending {
+            Some(p) if self.in_flight.len() < p.priority.window(self.window) => p
+                .not_before
+                .into_iter()
+                .chain(self.pacer.ready_at(p.priority))
+                .max(),
+            _ => None,
+        };
+        ack.into_iter().chain(due).min()
+    }
+
+    /// Settle the in-flight frame that `packet` echoes. Returns the acked
+    /// entry, or None if the packet isn't an echo of anything outstanding.
+    fn ack(&mut self, packet: &[u8], stats: &LinkStats) -> Option<InFlight> {
+        let pos = self
+            .in_flight
+            .iter()
+            .position(|f| f.frame.as_bytes()[..] == *packet)?;
+        // Frames sent before it will never be echoed now.
+        stats.lost.fetch_add(pos as u64, Ordering::Relaxed);
+        self.in_flight.drain(..pos);
+        if pos == 0 {
+            self.pacer.echoed(stats);
+        } else {
+            self.pacer.lost(stats);
+        }
+        self.in_flight.pop_front()
+    }
+
+    /// Whether `packet` echoes a frame given up less than `timeout` ago.
+    /// Frames given up before it won't be echoed now.
+    fn late_echo(&mut self, packet: &[u8], now: Instant, timeout: Duration) -> bool {
+        self.given_up.retain(|(_, at)| now < *at + timeout);
+        let Some(pos) = self
+            .given_up
+            .iter()
+            .position(|(f, _)| f.as_bytes()[..] == *packet)
+        else {
+            return false;
+        };
+        self.given_up.drain(..=pos);
+        true
+    }
+}
+
+impl Mailbox {
+    fn new(window: usize, stats: Arc<LinkStats>) -> Self {
+        Self {
+            slot: Mutex::new(Slot {
+                pending: None,
+                deferred: None,
+                in_flight: VecDeque::with_capacity(MAX_WINDOW),
+                given_up: VecDeque::with_capacity(MAX_WINDOW),
+                window: window.clamp(1, MAX_WINDOW),
+                pacer: Pacer::new(),
+                quiet_until: None,
+                open: true,
+            }),
+            ready: Notify::new(),
+            stats,
+        }
+    }
+
+    /// Replace the pending frame and wake the writer.
+    fn post(&self, frame: CctFrame, not_before: Option<Instant>, priority: Priority) {
+        let pending = Pending {
+            frame,
+            not_before,
+            priority,
+        };
+        if self.slot.lock().unwrap().post(pending, Instant::now()) {
+            self.ready.notify_one();
+        }
+    }
+
+    fn set_window(&self, window: usize) {
+        self.slot.lock().unwrap().window = window.clamp(1, MAX_WINDOW);
+        self.ready.notify_one();
+    }
+
+    /// Wait until there is a frame to put on the wire: the pending one once
+    /// it is due and the window has room, or a resend. Returns None once the
+    /// mailbox is closed. A frame posted while waiting replaces the held one.
+    async fn take(&self) -> Option<CctFrame> {
+        loop {
+            // `notify_one` leaves a permit if nobody is waiting yet, so a
+            // post between this check and the await still wakes us.
+            let posted = self.ready.notified();
+            let deadline = {
+                let mut slot = self.slot.lock().unwrap();
+                if !slot.open {
+                    return None;
+                }
+                let now = Instant::now();
+                let timeout = self.stats.ack_timeout();
+                if let Some(frame) = slot.expire(now, timeout, &self.stats) {
+                    return Some(frame);
+                }
+                if let Some(frame) = slot.dispatch(now) {
+                    return Some(frame);
+                }
+                slot.next_deadline(timeout)
+            };
+            match deadline {
+                Some(at) => {
+                    let at = tokio::time::Instant::from_std(at);
+                    let _ = tokio::time::timeout_at(at, posted).await;
+                }
+                None => posted.await,
+            }
+        }
+    }
+
+    /// Match a received packet against the in-flight frames. Returns true if
+    /// it was the echo of one of our writes, including one already given up
+    /// on, and false for unsolicited packets.
+    fn ack(&self, packet: &[u8]) -> bool {
+        let mut slot = self.slot.lock().unwrap();
+        let Some(entry) = slot.ack(packet, &self.stats) else {
+            let late = slot.late_echo(packet, Instant::now(), self.stats.ack_timeout());
+            if late {
+                self.stats.late.fetch_add(1, Ordering::Relaxed);
+            }
+            return late;
+        };
+        drop(slot);
+        self.ready.notify_one();
+        self.stats.acked.fetch_add(1, Ordering::Relaxed);
+        // Only time first sends: a resent frame's echo could belong to
+        // either copy.
+        if entry.attempts == 1 {
+            self.stats.sample(entry.sent_at.elapsed());
+        }
+        true
+    }
+
+    /// Nothing waiting to be sent and nothing awaiting its echo.
+    fn is_idle(&self) -> bool {
+        let slot = self.slot.lock().unwrap();
+        slot.pending.is_none() && slot.deferred.is_none() && slot.in_flight.is_empty()
+    }
+
+    /// Stop the writer; any unsent frame is discarded.
+    fn close(&self) {
+        let mut slot = self.slot.lock().unwrap();
+        slot.open = false;
+        slot.pending = None;
+        slot.deferred = None;
+        slot.in_flight.clear();
+        slot.given_up.clear();
+        self.ready.notify_one();
+    }
+}
+
+/// Delivery counters for one light, kept across reconnects of the same port.
+#[derive(Debug, Clone, Copy, Default, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct LinkCounters {
+    /// Smoothed echo round-trip in microseconds; None until measured.
+    pub rtt_us: Option<u64>,
+    /// Echoes timed since the port was opened.
+    pub samples: u64,
+    pub acked: u64,
+    pub retries: u64,
+    /// Frames that were never echoed, including superseded ones.
+    pub lost: u64,
+    /// Echoes that came back after their frame was counted lost.
+    pub late: u64,
+    /// Gap the writer currently keeps between sends.
+    pub send_interval_us: u64,
+    /// Received candidate packets that failed length or checksum checks.
+    pub resyncs: u64,
+}
+
+/// Echo timing and delivery statistics, shared by a light's writer and reader.
+///
+/// The light echoes every accepted command, so the time from starting a
+/// write to reading the same bytes back is a direct measure of port latency.
+struct LinkStats {
+    /// Smoothed round-trip time in microseconds; 0 until the first sample.
+    srtt_us: AtomicU64,
+    samples: AtomicU64,
+    acked: AtomicU64,
+    retries: AtomicU64,
+    lost: AtomicU64,
+    late: AtomicU64,
+    /// Published by the writer's pacer.
+    send_interval_us: AtomicU64,
+    /// Published by the reader's framer.
+    resyncs: AtomicU64,
+}
+
+impl LinkStats {
+    fn new() -> Self {
+        Self {
+            srtt_us: AtomicU64::new(0),
+            samples: AtomicU64::new(0),
+            acked: AtomicU64::new(0),
+            retries: AtomicU64::new(0),
+            lost: AtomicU64::new(0),
+            late: AtomicU64::new(0),
+            send_interval_us: AtomicU64::new(INITIAL_SEND_INTERVAL.as_micros() as u64),
+            resyncs: AtomicU64::new(0),
+        }
+    }
+
+    fn reset(&self) {
+        for counter in [
+            &self.srtt_us,
+            &self.samples,
+            &self.acked,
+            &self.retries,
+            &self.lost,
+            &self.late,
+            &self.resyncs,
+        ] {
+            counter.store(0, Ordering::Relaxed);
+        }
+        self.publish_interval(INITIAL_SEND_INTERVAL);
+    }
+
+    fn publish_interval(&self, interval: Duration) {
+        self.send_interval_us
+            .store(interval.as_micros() as u64, Ordering::Relaxed);
+    }
+
+    fn send_interval(&self) -> Duration {
+        Duration::from_micros(self.send_interval_us.load(Ordering::Relaxed))
+    }
+
+    fn sample(&self, rtt: Duration) {
+        let sample = rtt.as_micros() as u64;
+        // Same 1/8 smoothing as TCP's SRTT.
+        let srtt = match self.srtt_us.load(Ordering::Relaxed) {
+            0 => sample,
+            prev => prev - prev / 8 + sample / 8,
+        };
+        self.srtt_us.store(srtt.max(1), Ordering::Relaxed);
+        self.samples.fetch_add(1, Ordering::Relaxed);
+    }
+
+    fn rtt(&self) -> Option<Duration> {
+        match self.srtt_us.load(Ordering::Relaxed) {
+            0 => None,
+            us => Some(Duration::from_micros(us)),
+        }
+    }
+
+    /// How long to wait for an echo before resending: a few round-trips once
+    /// measured, so a slow hub isn't mistaken for loss.
+    fn ack_timeout(&self) -> Duration {
+        match self.rtt() {
+            Some(rtt) => (rtt * 4).clamp(MIN_ACK_TIMEOUT, MAX_ACK_TIMEOUT),
+            None => DEFAULT_ACK_TIMEOUT,
+        }
+    }
+
+    fn counters(&self) -> LinkCounters {
+        LinkCounters {
+            rtt_us: self.rtt().map(|d| d.as_micros() as u64),
+            samples: self.samples.load(Ordering::Relaxed),
+            acked: self.acked.load(Ordering::Relaxed),
+            retries: self.retries.load(Ordering::Relaxed),
+            lost: self.lost.load(Ordering::Relaxed),
+            late: self.late.load(Ordering::Relaxed),
+            send_interval_us: self.send_interval_us.load(Ordering::Relaxed),
+            resyncs: self.resyncs.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// What a reader can learn about one light without touching its link.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Serialize)]
+pub struct LinkSnapshot {
+    pub connected: bool,
+    /// Last state the light confirmed, by echo or by a status packet, since
+    /// it was connected.
+    pub brightness: Option<u8>,
+    pub kelvin: Option<u32>,
+}
+
+impl LinkSnapshot {
+    /// True if the light has confirmed exactly this brightness and Kelvin.
+    pub fn shows(&self, (brightness, kelvin): (u8, u32)) -> bool {
+        self.brightness == Some(brightness) && self.kelvin == Some(kelvin)
+    }
+}
+
+const STATE_KELVIN: u64 = 0xFFFF;
+const STATE_BRI_SHIFT: u32 = 16;
+const STATE_CONFIRMED: u64 = 1 << 24;
+const STATE_CONNECTED: u64 = 1 << 25;
+const STATE_GEN_SHIFT: u32 = 32;
+
+/// Connection status and confirmed state of one light, packed into a single
+/// word so readers never wait on the write path and always see the three
+/// fields together.
+///
+/// Each connection gets a generation in the high half; updates from a read
+/// task that has since been replaced are ignored.
+struct LinkState {
+    word: AtomicU64,
+    generations: AtomicU32,
+}
+
+impl LinkState {
+    fn new() -> Self {
+        Self {
+            word: AtomicU64::new(0),
+            generations: AtomicU32::new(0),
+        }
+    }
+
+    fn snapshot(&self) -> LinkSnapshot {
+        let word = self.word.load(Ordering::Acquire);
+        let confirmed = word & STATE_CONFIRMED != 0;
+        LinkSnapshot {
+            connected: word & STATE_CONNECTED != 0,
+            brightness: confirmed.then_some((word >> STATE_BRI_SHIFT) as u8),
+            kelvin: confirmed.then_some((word & STATE_KELVIN) as u32),
+        }
+    }
+
+    /// Mark a new connection up, with nothing confirmed yet. Returns its
+    /// generation.
+    fn open(&self) -> u32 {
+        let generation = self
+            .generations
+            .fetch_add(1, Ordering::Relaxed)
+            .wrapping_add(1);
+        self.word.store(
+            (generation as u64) << STATE_GEN_SHIFT | STATE_CONNECTED,
+            Ordering::Release,
+        );
+        generation
+    }
+
+    /// Apply `change` to the word if `generation` is still the current one.
+    fn update(&self, generation: u32, change: impl Fn(u64) -> u64) {
+        let _ = self
+            .word
+            .fetch_update(Ordering::Release, Ordering::Acquire, |word| {
+                ((word >> STATE_GEN_SHIFT) as u32 == generation).then(|| change(word))
+            });
+    }
+
+    fn confirm(&self, generation: u32, brightness: u8, kelvin: u32) {
+        self.update(generation, |word| {
+            word & !(STATE_KELVIN | 0xFF << STATE_BRI_SHIFT)
+                | STATE_CONFIRMED
+                | (brightness as u64) << STATE_BRI_SHIFT
+                | kelvin as u64 & STATE_KELVIN
+        });
+    }
+
+    fn close(&self, generation: u32) {
+        self.update(generation, |word| word & !STATE_CONNECTED);
+    }
+}
+
+/// Minimum spacing of "light-status" events from one light: one per 60 Hz
+/// display frame.
+const STATUS_INTERVAL: Duration = Duration::from_micros(16_667);
+
+/// Rate limit for "light-status" events from one light.
+///
+/// A state identical to the last one emitted is dropped. The first change
+/// after a quiet spell goes out at once; changes inside the interval collapse
+/// into one trailing event carrying the latest state, so a fast knob turn
+/// costs the webview at most one update per frame and still ends exact.
+struct StatusThrottle {
+    last: Option<(u8, u32)>,
+    pending: Option<(u8, u32)>,
+    next_at: Option<Instant>,
+}
+
+impl StatusThrottle {
+    fn new() -> Self {
+        Self {
+            last: None,
+            pending: None,
+            next_at: None,
+        }
+    }
+
+    /// Take a newly parsed (brightness, Kelvin). Returns it if it should be
+    /// emitted now; otherwise it is held for `poll`.
+    fn offer(&mut self, state: (u8, u32), now: Instant) -> Option<(u8, u32)> {
+        if self.last == Some(state) {
+            self.pending = None;
+            return None;
+        }
+        if self.next_at.is_some_and(|at| now < at) {
+            self.pending = Some(state);
+            return None;
+        }
+        self.emitted(state, now)
+    }
+
+    /// Returns the held state once its slot has come.
+    fn poll(&mut self, now: Instant) -> Option<(u8, u32)> {
+        let state = self.pending?;
+        if self.next_at.is_some_and(|at| now < at) {
+            return None;
+        }
+        self.emitted(state, now)
+    }
+
+    /// The light echoed one of our writes: it now shows `state`, which the
+    /// UI already knows. A knob change to come is compared against this
+    /// state, and one still held is older than the write, so it is dropped.
+    fn echoed(&mut self, state: (u8, u32)) {
+        self.last = Some(state);
+        self.pending = None;
+    }
+
+    /// When `poll` will have something to emit.
+    fn deadline(&self) -> Option<Instant> {
+        self.pending.and(self.next_at)
+    }
+
+    fn emitted(&mut self, state: (u8, u32), now: Instant) -> Option<(u8, u32)> {
+        self.last = Some(state);
+        self.pending = None;
+        self.next_at = Some(now + STATUS_INTERVAL);
+        Some(state)
+    }
+}
+
+/// Stop signal for one connection's read task, and its handle on the
+/// light's shared state.
+struct ReadStop {
+    running: AtomicBool,
+    stopped: Notify,
+    state: Arc<LinkState>,
+    generation: u32,
+}
+
+impl ReadStop {
+    fn new(state: Arc<LinkState>) -> Self {
+        Self {
+            running: AtomicBool::new(true),
+            stopped: Notify::new(),
+            generation: state.open(),
+            state,
+        }
+    }
+
+    fn is_running(&self) -> bool {
+        self.running.load(Ordering::Relaxed)
+    }
+
+    fn stop(&self) {
+        self.running.store(false, Ordering::Relaxed);
+        self.state.close(self.generation);
+        self.stopped.notify_one();
+    }
+
+    fn confirm(&self, brightness: u8, kelvin: u32) {
+        self.state.confirm(self.generation, brightness, kelvin);
+    }
+
+    /// Resolves once `stop` has been called.
+    async fn wait(&self) {
+        while self.is_running() {
+            self.stopped.notified().await;
+        }
+    }
+}
+
+/// Background tasks serving the open connection.
+struct Link {
+    mailbox: Arc<Mailbox>,
+    reader: Arc<ReadStop>,
+}
+
+impl Link {
+    fn close(&self) {
+        self.mailbox.close();
+        self.reader.stop();
+    }
+}
+
+/// Connection to a single light. See `fleet` for managing several.
+pub struct SerialManager {
+    id: String,
+    model: ModelKind,
+    link: Mutex<Option<Link>>,
+    state: Arc<LinkState>,
+    stats: Arc<LinkStats>,
+    window: AtomicUsize,
+}
+
+impl SerialManager {
+    pub fn new(id: String) -> Self {
+        Self::with_model(id, ModelKind::default())
+    }
+
+    pub fn with_model(id: String, model: ModelKind) -> Self {
+        Self {
+            id,
+            model,
+            link: Mutex::new(None),
+            state: Arc::new(LinkState::new()),
+            stats: Arc::new(LinkStats::new()),
+            window: AtomicUsize::new(DEFAULT_WINDOW),
+        }
+    }
 
-        // Clone the port for the read thread
-        let reader = port
-            .try_clone()
-            .map_err(|e| format!("Failed to clone port: {e}"))?;
+    /// Open the serial port and start its read and write tasks.
+    pub async fn connect(&self, path: &str, events: impl LinkEvents) -> Result<(), String> {
+        // Stop any existing read loop and writer
+        if let Some(link) = self.link.lock().unwrap().take() {
+            link.close();
+        }
+
+        let port = tokio_serial::new(path, 115200)
+            .data_bits(tokio_serial::DataBits::Eight)
+            .parity(tokio_serial::Parity::None)
+            .stop_bits(tokio_serial::StopBits::One)
+            .open_native_async()
+            .map_err(|e| format!("Failed to open {path}: {e}"))?;
+        let (reader, writer) = tokio::io::split(port);
+        let (tx_tap, rx_tap) = capture::tap(&self.id).unzip();
+        let stop = Arc::new(ReadStop::new(self.state.clone()));
 
-        *self.port.lock().unwrap() = Some(port);
+        // A new path may sit on a different hub branch; measure afresh.
+        self.stats.reset();
 
-        // Start background read loop
-        let reading = self.reading.clone();
-        reading.store(true, Ordering::Relaxed);
+        let mailbox = Arc::new(Mailbox::new(
+            self.window.load(Ordering::Relaxed),
+            self.stats.clone(),
+        ));
+        tauri::async_runtime::spawn(write_loop(writer, mailbox.clone(), tx_tap));
+        tauri::async_runtime::spawn(read_loop(
+            reader,
+            rx_tap,
+            self.id.clone(),
+            self.model,
+            stop.clone(),
+            mailbox.clone(),
+            events,
+        ));
 
-        std::thread::spawn(move || {
-            read_loop(reader, reading, app);
+        *self.link.lock().unwrap() = Some(Link {
+            mailbox,
+            reader: stop,
         });
 
         Ok(())
     }
 
-    /// Send raw bytes to the light.
-    pub fn write(&self, data: &[u8]) -> Result<(), String> {
-        let mut lock = self.port.lock().unwrap();
-        let port = lock.as_mut().ok_or("Port not open")?;
-        port.write_all(data).map_err(|e| format!("Write failed: {e}"))?;
-        port.flush().map_err(|e| format!("Flush failed: {e}"))?;
+    pub fn id(&self) -> &str {
+        &self.id
+    }
+
+    pub fn model(&self) -> ModelKind {
+        self.model
+    }
+
+    /// Queue a state for the writer task and return immediately. It is
+    /// encoded here, once, for this light's model.
+    ///
+    /// Replaces any frame still waiting to be sent, unless `priority` is
+    /// background and the waiting frame isn't.
+    pub fn submit(&self, cct: Cct, priority: Priority) -> Result<(), String> {
+        self.post(cct, None, priority)
+    }
+
+    /// Like `submit`, but the writer holds the frame until `due`.
+    pub fn submit_at(&self, cct: Cct, due: Instant) -> Result<(), String> {
+        self.post(cct, Some(due), Priority::Interactive)
+    }
+
+    /// Like `submit`, but skips the frame if the light already shows it: it
+    /// has confirmed the same brightness and temperature step, and nothing
+    /// else is on its way. Returns whether the frame was queued.
+    pub fn submit_changed(&self, cct: Cct) -> Result<bool, String> {
+        let lock = self.link.lock().unwrap();
+        let link = self.open_link(&lock)?;
+        let frame = self.model.encode(cct);
+        // Compare after quantization: Kelvin values on the same step match.
+        let target = self.model.decode(&frame);
+        if link.mailbox.is_idle() && target.is_some_and(|t| self.state.snapshot().shows(t)) {
+            return Ok(false);
+        }
+        link.mailbox.post(frame, None, Priority::Interactive);
+        Ok(true)
+    }
+
+    fn post(
+        &self,
+        cct: Cct,
+        not_before: Option<Instant>,
+        priority: Priority,
+    ) -> Result<(), String> {
+        let lock = self.link.lock().unwrap();
+        let link = self.open_link(&lock)?;
+        link.mailbox
+            .post(self.model.encode(cct), not_before, priority);
         Ok(())
     }
 
-    /// Check if the port is currently open.
+    /// The link to post to, unless the port was never opened or has since
+    /// been lost (read error or unplug), which leaves the link in place
+    /// until the next connect.
+    fn open_link<'a>(&self, link: &'a Option<Link>) -> Result<&'a Link, String> {
+        match link {
+            Some(link) if self.is_connected() => Ok(link),
+            _ => Err("Port not open".into()),
+        }
+    }
+
+    /// Smoothed echo round-trip time, once at least one echo has been timed.
+    pub fn echo_rtt(&self) -> Option<Duration> {
+        self.stats.rtt()
+    }
+
+    /// Gap the writer keeps between sends, learned from echoes and losses.
+    pub fn send_interval(&self) -> Duration {
+        self.stats.send_interval()
+    }
+
+    /// Echo timing and delivery counters since the port was opened.
+    pub fn counters(&self) -> LinkCounters {
+        self.stats.counters()
+    }
+
+    /// Set how many frames may await their echo at once (1 to `MAX_WINDOW`).
+    /// Takes effect immediately and is kept across reconnects.
+    pub fn set_window(&self, window: usize) {
+        let window = window.clamp(1, MAX_WINDOW);
+        self.window.store(window, Ordering::Relaxed);
+        if let Some(link) = self.link.lock().unwrap().as_ref() {
+            link.mailbox.set_window(window);
+        }
+    }
+
+    /// Check if the port is currently open. Never waits on the link.
     pub fn is_connected(&self) -> bool {
-        self.port.lock().unwrap().is_some()
+        self.state.snapshot().connected
     }
 
-    /// Disconnect and stop the read loop.
+    /// Connection status and last confirmed state. Never waits on the link.
+    pub fn snapshot(&self) -> LinkSnapshot {
+        self.state.snapshot()
+    }
+
+    /// Disconnect and stop the read and write tasks. The port closes once
+    /// both have let go of it.
     pub fn disconnect(&self) {
-        self.reading.store(false, Ordering::Relaxed);
-        *self.port.lock().unwrap() = None;
+        if let Some(link) = self.link.lock().unwrap().take() {
+            link.close();
+        }
+    }
+}
+
+/// Background writer — sends the newest pending frame whenever the window
+/// has room, and resends it if its echo doesn't come back.
+async fn write_loop(
+    mut port: WriteHalf<SerialStream>,
+    mailbox: Arc<Mailbox>,
+    mut tap: Option<Tap>,
+) {
+    while let Some(frame) = mailbox.take().await {
+        // A failed write means the port went away; the read loop reports it.
+        if port.write_all(frame.as_bytes()).await.is_err() || port.flush().await.is_err() {
+            break;
+        }
+        if let Some(tap) = &mut tap {
+            tap.record(frame.as_bytes());
+        }
+        latency::written(&frame);
+    }
+}
+
+/// Sort a packet from the light into an echo of one of our writes, which
+/// carries nothing the UI doesn't know, or a knob report. Returns the state
+/// to emit now, if any.
+fn report(
+    packet: &[u8],
+    status: Option<(u8, u32)>,
+    mailbox: &Mailbox,
+    throttle: &mut StatusThrottle,
+) -> Option<(u8, u32)> {
+    if mailbox.ack(packet) {
+        latency::echoed(packet);
+        if let Some(state) = status {
+            throttle.echoed(state);
+        }
+        return None;
     }
+    throttle.offer(status?, Instant::now())
 }
 
-/// Background read loop — parses 8-byte status packets and emits events.
-fn read_loop(
-    mut port: Box<dyn serialport::SerialPort>,
-    running: Arc<AtomicBool>,
-    app: AppHandle,
+/// Background read loop — frames incoming bytes and emits status events.
+async fn read_loop(
+    mut port: ReadHalf<SerialStream>,
+    mut tap: Option<Tap>,
+    id: String,
+    model: ModelKind,
+    stop: Arc<ReadStop>,
+    mailbox: Arc<Mailbox>,
+    events: impl LinkEvents,
 ) {
     let mut buf = [0u8; 256];
-    let mut accum: Vec<u8> = Vec::new();
-
-    while running.load(Ordering::Relaxed) {
-        match port.read(&mut buf) {
-            Ok(n) if n > 0 => {
-                accum.extend_from_slice(&buf[..n]);
-                // Try to parse complete 8-byte packets
-                while accum.len() >= 8 {
-                    // Find 0x3A start byte
-                    if let Some(start) = accum.iter().position(|&b| b == 0x3A) {
-                        if start > 0 {
-                            accum.drain(..start);
-                        }
-                        if accum.len() < 8 {
-                            break;
-                        }
-                        if let Some((bri, temp_byte)) = protocol::parse_status(&accum[..8]) {
-                            let status = LightStatus {
-                                brightness: bri,
-                                kelvin: protocol::byte_to_kelvin(temp_byte),
-                            };
-                            let _ = app.emit("light-status", &status);
-                        }
-                        accum.drain(..8);
-                    } else {
-                        accum.clear();
-                        break;
-                    }
+    let mut framer = Framer::new();
+    let mut throttle = StatusThrottle::new();
+    let emit_status = |(brightness, kelvin): (u8, u32)| {
+        events.status(LightStatus {
+            id: id.clone(),
+            brightness,
+            kelvin,
+        })
+    };
+
+    loop {
+        // A held status goes out when its slot comes, even if the line is quiet.
+        let held = async {
+            match throttle.deadline() {
+                Some(at) => tokio::time::sleep_until(tokio::time::Instant::from_std(at)).await,
+                None => std::future::pending().await,
+            }
+        };
+        let read = tokio::select! {
+            _ = stop.wait() => break,
+            _ = held => None,
+            read = port.read(&mut buf) => Some(read),
+        };
+        match read {
+            None => {
+                if let Some(state) = throttle.poll(Instant::now()) {
+                    emit_status(state);
                 }
             }
-            Err(ref e) if e.kind() == std::io::ErrorKind::TimedOut => continue,
-            Err(_) => {
-                let _ = app.emit("serial-disconnected", ());
+            Some(Ok(n)) if n > 0 => {
+                if let Some(tap) = &mut tap {
+                    tap.record(&buf[..n]);
+                }
+                framer.feed(&buf[..n], |frame| {
+                    // Echoes and knob reports alike are the light's actual state.
+                    let status = model.decode(frame);
+                    if let Some((bri, kelvin)) = status {
+                        stop.confirm(bri, kelvin);
+                    }
+                    if let Some(state) = report(frame, status, &mailbox, &mut throttle) {
+                        emit_status(state);
+                    }
+                });
+                mailbox
+                    .stats
+                    .resyncs
+                    .store(framer.resyncs(), Ordering::Relaxed);
+            }
+            // End of file or an error: the device is gone.
+            Some(_) => {
+                lost_port(&stop, &mailbox, &events, &id);
                 break;
             }
-            _ => continue,
         }
     }
 }
+
+/// The port went away under the read loop: shut the link down so the light
+/// reads as disconnected, then tell the frontend.
+fn lost_port(stop: &ReadStop, mailbox: &Mailbox, events: &impl LinkEvents, id: &str) {
+    stop.stop();
+    mailbox.close();
+    events.disconnected(id);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::protocol;
+
+    fn mailbox(window: usize) -> Mailbox {
+        Mailbox::new(window, Arc::new(LinkStats::new()))
+    }
+
+    fn block_on<F: std::future::Future>(future: F) -> F::Output {
+        tokio::runtime::Builder::new_current_thread()
+            .enable_time()
+            .build()
+            .unwrap()
+            .block_on(future)
+    }
+
+    #[test]
+    fn test_mailbox_keeps_latest() {
+        let mailbox = mailbox(1);
+        mailbox.post(protocol::cct_command(10, 4950), None, Priority::Interactive);
+        mailbox.post(protocol::cct_command(20, 4950), None, Priority::Interactive);
+        assert_eq!(
+            block_on(mailbox.take()),
+            Some(protocol::cct_command(20, 4950))
+        );
+    }
+
+    #[test]
+    fn test_mailbox_holds_until_due() {
+        let mailbox = mailbox(1);
+        let due = Instant::now() + Duration::from_millis(20);
+        mailbox.post(
+            protocol::cct_command(10, 4950),
+            Some(due),
+            Priority::Interactive,
+        );
+        assert_eq!(
+            block_on(mailbox.take()),
+            Some(protocol::cct_command(10, 4950))
+        );
+        assert!(Instant::now() >= due);
+    }
+
+    #[test]
+    fn test_mailbox_close_wakes_writer() {
+        let mailbox = mailbox(1);
+        let taken = block_on(async {
+            tokio::join!(mailbox.take(), async {
+                tokio::task::yield_now().await;
+                mailbox.close();
+            })
+            .0
+        });
+        assert_eq!(taken, None);
+    }
+
+    #[test]
+    fn test_pacer_backs_off_on_loss() {
+        let stats = LinkStats::new();
+        let mut slot = mailbox(4).slot.into_inner().unwrap();
+        let t0 = Instant::now();
+        let frame = |bri| Pending {
+            frame: protocol::cct_command(bri, 4950),
+            not_before: None,
+            priority: Priority::Background,
+        };
+
+        slot.pending = Some(frame(10));
+        assert!(slot.dispatch(t0).is_some());
+        // Too soon after the last send: held, and due when the gap is up.
+        slot.pending = Some(frame(20));
+        assert_eq!(slot.dispatch(t0), None);
+        let due = t0 + INITIAL_SEND_INTERVAL;
+        assert_eq!(slot.next_deadline(MAX_ACK_TIMEOUT), Some(due));
+        assert!(slot.dispatch(due).is_some());
+
+        // Echo 20 but not 10: a loss, so the gap doubles.
+        assert!(slot.ack(&protocol::cct_command(20, 4950), &stats).is_some());
+        assert_eq!(stats.send_interval(), INITIAL_SEND_INTERVAL * 2);
+
+        // Clean echoes close it again, down to the line's own limit.
+        for _ in 0..1000 {
+            slot.pacer.echoed(&stats);
+        }
+        assert_eq!(stats.send_interval(), MIN_SEND_INTERVAL);
+        for _ in 0..20 {
+            slot.pacer.lost(&stats);
+        }
+        assert_eq!(stats.send_interval(), MAX_SEND_INTERVAL);
+    }
+
+    #[test]
+    fn test_foreground_preempts_background() {
+        let mut slot = mailbox(2).slot.into_inner().unwrap();
+        let t0 = Instant::now();
+        let frame = |bri, priority| Pending {
+            frame: protocol::cct_command(bri, 4950),
+            not_before: None,
+            priority,
+        };
+
+        // Right after a fade frame, the panel's change waits out only the
+        // line's minimum gap, not the fade's.
+        assert!(slot.post(frame(10, Priority::Background), t0));
+        assert!(slot.dispatch(t0).is_some());
+        assert!(slot.post(frame(20, Priority::Interactive), t0));
+        assert_eq!(slot.dispatch(t0), None);
+        let t1 = t0 + MIN_SEND_INTERVAL;
+        assert_eq!(slot.next_deadline(MAX_ACK_TIMEOUT), Some(t1));
+        assert_eq!(slot.dispatch(t1), Some(protocol::cct_command(20, 4950)));
+
+        // The window is full; only a power change has a slot past it.
+        let t2 = t1 + MIN_SEND_INTERVAL;
+        assert!(slot.post(frame(25, Priority::Interactive), t1));
+        assert_eq!(slot.dispatch(t2), None);
+        assert!(slot.post(frame(30, Priority::Power), t1));
+        // A fade step right behind it waits until the hold is over.
+        assert!(slot.post(frame(40, Priority::Background), t1));
+        assert_eq!(slot.dispatch(t2), Some(protocol::cct_command(30, 4950)));
+        let later = t1 + BACKGROUND_HOLD;
+        slot.in_flight.clear();
+        assert_eq!(slot.dispatch(t2), None);
+        assert_eq!(slot.next_deadline(MAX_ACK_TIMEOUT), Some(later));
+        assert_eq!(slot.dispatch(later), Some(protocol::cct_command(40, 4950)));
+
+        // A foreground frame waiting on its due time isn't displaced, and a
+        // newer foreground post drops the fade step deferred behind it.
+        let due = later + BACKGROUND_HOLD;
+        let synced = Pending {
+            not_before: Some(due),
+            ..frame(60, Priority::Interactive)
+        };
+        assert!(slot.post(synced, later));
+        assert!(slot.post(frame(70, Priority::Background), due));
+        assert!(slot.pending.is_some_and(|p| p.frame == synced.frame));
+        assert!(slot.post(synced, later));
+        assert!(slot.deferred.is_none());
+    }
+
+    #[test]
+    fn test_last_fade_step_in_hold_is_sent() {
+        let mut slot = mailbox(2).slot.into_inner().unwrap();
+        let t0 = Instant::now();
+        let frame = |bri, priority| Pending {
+            frame: protocol::cct_command(bri, 4950),
+            not_before: None,
+            priority,
+        };
+        // A reconnect's restore goes out while a fade is finishing.
+        assert!(slot.post(frame(10, Priority::Interactive), t0));
+        assert!(slot.dispatch(t0).is_some());
+        assert!(slot.post(frame(90, Priority::Background), t0));
+        assert!(slot.deferred.is_some());
+        // Nothing newer comes; the fade's target still goes out.
+        let later = t0 + BACKGROUND_HOLD;
+        assert_eq!(slot.dispatch(t0), None);
+        assert_eq!(slot.dispatch(later), Some(protocol::cct_command(90, 4950)));
+    }
+
+    #[test]
+    fn test_background_skips_frame_on_its_way() {
+        let mut slot = mailbox(2).slot.into_inner().unwrap();
+        let t0 = Instant::now();
+        let frame = |bri| Pending {
+            frame: protocol::cct_command(bri, 4950),
+            not_before: None,
+            priority: Priority::Background,
+        };
+        assert!(slot.post(frame(10), t0));
+        assert!(!slot.post(frame(10), t0));
+        assert!(slot.dispatch(t0).is_some());
+        // Still waiting for its echo.
+        assert!(!slot.post(frame(10), t0));
+        assert!(slot.post(frame(20), t0));
+    }
+
+    #[test]
+    fn test_unchanged_after_quantization() {
+        let state = LinkState::new();
+        let generation = state.open();
+        state.confirm(generation, 50, 4950);
+        let shows = |frame: CctFrame| {
+            let target = ModelKind::Pl81Pro.decode(&frame).unwrap();
+            state.snapshot().shows(target)
+        };
+        // 4960K is on the same temperature step as 4950K.
+        assert!(shows(protocol::cct_command(50, 4960)));
+        assert!(!shows(protocol::cct_command(51, 4950)));
+        assert!(!shows(protocol::cct_command(50, 5200)));
+        // Nothing confirmed yet: always send.
+        state.open();
+        assert!(!shows(protocol::cct_command(50, 4950)));
+    }
+
+    #[test]
+    fn test_link_state_ignores_replaced_connections() {
+        let state = LinkState::new();
+        assert_eq!(state.snapshot(), LinkSnapshot::default());
+
+        let old = state.open();
+        state.confirm(old, 40, 5600);
+        assert_eq!(
+            state.snapshot(),
+            LinkSnapshot {
+                connected: true,
+                brightness: Some(40),
+                kelvin: Some(5600),
+            }
+        );
+
+        // A reconnect starts unconfirmed, and the old reader can't touch it.
+        let new = state.open();
+        state.confirm(old, 90, 2900);
+        state.close(old);
+        assert_eq!(
+            state.snapshot(),
+            LinkSnapshot {
+                connected: true,
+                ..LinkSnapshot::default()
+            }
+        );
+        state.confirm(new, 100, 7000);
+        state.close(new);
+        assert_eq!(
+            state.snapshot(),
+            LinkSnapshot {
+                connected: false,
+                brightness: Some(100),
+                kelvin: Some(7000),
+            }
+        );
+    }
+
+    #[test]
+    fn test_status_throttle_dedups_and_trails() {
+        let mut throttle = StatusThrottle::new();
+        let t0 = Instant::now();
+        assert_eq!(throttle.offer((10, 4950), t0), Some((10, 4950)));
+        assert_eq!(throttle.offer((10, 4950), t0), None);
+
+        // A burst inside one interval is held, and only the latest survives.
+        let t1 = t0 + STATUS_INTERVAL / 4;
+        assert_eq!(throttle.offer((20, 4950), t1), None);
+        assert_eq!(throttle.offer((30, 4950), t1), None);
+        assert_eq!(throttle.deadline(), Some(t0 + STATUS_INTERVAL));
+        assert_eq!(throttle.poll(t1), None);
+        let t2 = t0 + STATUS_INTERVAL;
+        assert_eq!(throttle.poll(t2), Some((30, 4950)));
+        assert_eq!(throttle.deadline(), None);
+
+        // Turning back to the state already shown cancels the held one.
+        assert_eq!(throttle.offer((40, 4950), t2), None);
+        assert_eq!(throttle.offer((30, 4950), t2), None);
+        assert_eq!(throttle.poll(t2 + STATUS_INTERVAL), None);
+    }
+
+    #[test]
+    fn test_status_throttle_follows_echoes() {
+        let mut throttle = StatusThrottle::new();
+        let t0 = Instant::now();
+        // Knob to 50, then the panel writes 70 and the light echoes it.
+        assert_eq!(throttle.offer((50, 4950), t0), Some((50, 4950)));
+        throttle.echoed((70, 4950));
+        // Turning the knob back to 50 is a change again.
+        let t1 = t0 + STATUS_INTERVAL;
+        assert_eq!(throttle.offer((50, 4950), t1), Some((50, 4950)));
+
+        // A knob state held before a write doesn't fire after its echo.
+        assert_eq!(throttle.offer((40, 4950), t1), None);
+        throttle.echoed((70, 4950));
+        assert_eq!(throttle.deadline(), None);
+        assert_eq!(throttle.poll(t1 + STATUS_INTERVAL), None);
+    }
+
+    #[test]
+    fn test_window_limits_frames_in_flight() {
+        let mailbox = mailbox(2);
+        let mut slot = mailbox.slot.lock().unwrap();
+        let mut now = Instant::now();
+        for bri in [10, 20, 30] {
+            slot.pending = Some(Pending {
+                frame: protocol::cct_command(bri, 4950),
+                not_before: None,
+                priority: Priority::Background,
+            });
+            let sent = slot.dispatch(now);
+            assert_eq!(sent.is_some(), bri != 30);
+            now += MAX_SEND_INTERVAL;
+        }
+        // The echo of the first frame frees a place for the third.
+        let first = protocol::cct_command(10, 4950);
+        assert!(slot.ack(&first, &mailbox.stats).is_some());
+        assert_eq!(slot.dispatch(now), Some(protocol::cct_command(30, 4950)));
+    }
+
+    #[test]
+    fn test_echo_settles_older_frames() {
+        let mailbox = mailbox(4);
+        let a = protocol::cct_command(10, 4950);
+        let b = protocol::cct_command(20, 4950);
+        mailbox.post(a, None, Priority::Interactive);
+        assert_eq!(block_on(mailbox.take()), Some(a));
+        mailbox.post(b, None, Priority::Interactive);
+        assert_eq!(block_on(mailbox.take()), Some(b));
+
+        // A knob packet is not an echo.
+        assert!(!mailbox.ack(&protocol::cct_command(90, 2900)));
+        assert!(mailbox.ack(&b));
+        let counters = mailbox.stats.counters();
+        assert_eq!((counters.acked, counters.lost, counters.samples), (1, 1, 1));
+        assert!(mailbox.slot.lock().unwrap().in_flight.is_empty());
+    }
+
+    #[test]
+    fn test_only_newest_frame_is_retried() {
+        let mailbox = mailbox(4);
+        let timeout = Duration::from_millis(50);
+        let mut slot = mailbox.slot.lock().unwrap();
+        let mut start = Instant::now();
+        let a = protocol::cct_command(10, 4950);
+        let b = protocol::cct_command(20, 4950);
+        for frame in [a, b] {
+            slot.pending = Some(Pending {
+                frame,
+                not_before: None,
+                priority: Priority::Background,
+            });
+            assert!(slot.dispatch(start).is_some());
+            start += INITIAL_SEND_INTERVAL;
+        }
+
+        let late = start + timeout;
+        // The superseded frame is dropped; the newest one goes out again.
+        assert_eq!(slot.expire(late, timeout, &mailbox.stats), Some(b));
+        assert_eq!(slot.expire(late, timeout, &mailbox.stats), None);
+        let mut at = late;
+        for _ in 2..MAX_ATTEMPTS {
+            at += timeout;
+            assert_eq!(slot.expire(at, timeout, &mailbox.stats), Some(b));
+        }
+        assert_eq!(slot.expire(at + timeout, timeout, &mailbox.stats), None);
+        let counters = mailbox.stats.counters();
+        assert_eq!(
+            (counters.retries, counters.lost),
+            (MAX_ATTEMPTS as u64 - 1, 2)
+        );
+    }
+
+    #[test]
+    fn test_late_echo_is_not_a_knob_report() {
+        let mailbox = mailbox(1);
+        let timeout = mailbox.stats.ack_timeout();
+        let a = protocol::cct_command(10, 4950);
+        let b = protocol::cct_command(20, 4950);
+        let t0 = Instant::now();
+        {
+            // A times out with B waiting behind it, so it is given up.
+            let mut slot = mailbox.slot.lock().unwrap();
+            slot.pending = Some(Pending {
+                frame: a,
+                not_before: None,
+                priority: Priority::Background,
+            });
+            assert_eq!(slot.dispatch(t0), Some(a));
+            slot.pending = Some(Pending {
+                frame: b,
+                not_before: None,
+                priority: Priority::Background,
+            });
+            assert_eq!(slot.expire(t0 + timeout, timeout, &mailbox.stats), None);
+            assert_eq!(slot.dispatch(t0 + timeout), Some(b));
+        }
+
+        // Its echo turns up after all, then B's: neither is a knob change.
+        let mut throttle = StatusThrottle::new();
+        for frame in [a, b] {
+            let status = ModelKind::Pl81Pro.decode(&frame);
+            assert_eq!(report(&frame, status, &mailbox, &mut throttle), None);
+        }
+        assert_eq!(throttle.deadline(), None);
+        let counters = mailbox.stats.counters();
+        assert_eq!((counters.acked, counters.lost, counters.late), (1, 1, 1));
+        // Once matched, the same packet again is the knob.
+        let status = ModelKind::Pl81Pro.decode(&a);
+        assert_eq!(report(&a, status, &mailbox, &mut throttle), status);
+    }
+}
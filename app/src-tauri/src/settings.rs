@@ -0,0 +1,181 @@
+/// Write-behind persistence for settings.json.
+///
+/// Settings live in memory. Updates only mark them dirty; a background
+/// thread writes the whole file once changes have gone quiet, so a slider
+/// drag, knob sweep or fade costs one disk write instead of one per step.
+/// Writes are atomic (temp file, then rename) and `flush` runs on quit.
+///
+/// The file is the flat JSON object tauri-plugin-store kept in the app data
+/// directory, so existing settings carry over.
+use std::fs;
+use std::io::Write;
+use std::path::{Path, PathBuf};
+use std::sync::{Condvar, Mutex};
+use std::time::{Duration, Instant};
+
+use serde::de::DeserializeOwned;
+use serde_json::{Map, Value};
+
+/// Quiet time after the last change before writing.
+const QUIET: Duration = Duration::from_millis(500);
+/// Longest a change may stay unsaved while updates keep coming.
+const MAX_DELAY: Duration = Duration::from_secs(5);
+
+pub struct Settings {
+    path: PathBuf,
+    state: Mutex<State>,
+    changed: Condvar,
+    /// Serializes writers so a flush on quit can't race the background one.
+    writing: Mutex<()>,
+}
+
+struct State {
+    values: Map<String, Value>,
+    /// First and latest unsaved change.
+    dirty: Option<(Instant, Instant)>,
+}
+
+impl Settings {
+    /// Load `path`, starting empty if it is missing or unreadable.
+    pub fn load(path: PathBuf) -> Self {
+        let values = fs::read(&path)
+            .ok()
+            .and_then(|bytes| serde_json::from_slice(&bytes).ok())
+            .unwrap_or_default();
+        Self {
+            path,
+            state: Mutex::new(State {
+                values,
+                dirty: None,
+            }),
+            changed: Condvar::new(),
+            writing: Mutex::new(()),
+        }
+    }
+
+    pub fn get_all(&self) -> Map<String, Value> {
+        self.state.lock().unwrap().values.clone()
+    }
+
+    /// Deserialize one entry, or None if it is missing or malformed.
+    pub fn get<T: DeserializeOwned>(&self, key: &str) -> Option<T> {
+        let value = self.state.lock().unwrap().values.get(key).cloned()?;
+        serde_json::from_value(value).ok()
+    }
+
+    /// Merge `patch` into the settings. Values that don't change don't
+    /// schedule a write.
+    pub fn update(&self, patch: Map<String, Value>) {
+        let mut state = self.state.lock().unwrap();
+        let mut changed = false;
+        for (key, value) in patch {
+            if state.values.get(&key) != Some(&value) {
+                state.values.insert(key, value);
+                changed = true;
+            }
+        }
+        if changed {
+            let now = Instant::now();
+            let first = state.dirty.map_or(now, |(first, _)| first);
+            state.dirty = Some((first, now));
+            self.changed.notify_one();
+        }
+    }
+
+    /// Write now if anything is unsaved.
+    pub fn flush(&self) -> Result<(), String> {
+        let _writing = self.writing.lock().unwrap();
+        let (values, dirty) = {
+            let mut state = self.state.lock().unwrap();
+            match state.dirty.take() {
+                Some(dirty) => (state.values.clone(), dirty),
+                None => return Ok(()),
+            }
+        };
+        write_atomic(&self.path, &values).inspect_err(|_| {
+            // Keep it dirty so the next flush retries, unless newer changes
+            // have marked it already.
+            let mut state = self.state.lock().unwrap();
+            state.dirty.get_or_insert(dirty);
+        })
+    }
+
+    /// Background writer: flushes once changes have been quiet for `QUIET`,
+    /// or `MAX_DELAY` after the first unsaved one. Never returns.
+    pub fn run_writer(&self) {
+        let mut state = self.state.lock().unwrap();
+        loop {
+            let Some((first, last)) = state.dirty else {
+                state = self.changed.wait(state).unwrap();
+                continue;
+            };
+            let due = (last + QUIET).min(first + MAX_DELAY);
+            let now = Instant::now();
+            if now < due {
+                state = self.changed.wait_timeout(state, due - now).unwrap().0;
+                continue;
+            }
+            drop(state);
+            if self.flush().is_err() {
+                // Don't spin on a full or read-only disk.
+                std::thread::sleep(MAX_DELAY);
+            }
+            state = self.state.lock().unwrap();
+        }
+    }
+}
+
+/// Replace `path` so that readers only ever see the old or the new file.
+fn write_atomic(path: &Path, values: &Map<String, Value>) -> Result<(), String> {
+    if let Some(dir) = path.parent() {
+        fs::create_dir_all(dir).map_err(|e| format!("Failed to create {}: {e}", dir.display()))?;
+    }
+    let bytes = serde_json::to_vec_pretty(values).map_err(|e| e.to_string())?;
+    let tmp = path.with_extension("json.tmp");
+    let mut file =
+        fs::File::create(&tmp).map_err(|e| format!("Failed to create {}: {e}", tmp.display()))?;
+    file.write_all(&bytes)
+        .and_then(|_| file.sync_all())
+        .map_err(|e| format!("Failed to write {}: {e}", tmp.display()))?;
+    fs::rename(&tmp, path).map_err(|e| format!("Failed to replace {}: {e}", path.display()))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::json;
+
+    fn patch(value: Value) -> Map<String, Value> {
+        value.as_object().unwrap().clone()
+    }
+
+    fn temp_path(name: &str) -> PathBuf {
+        let dir =
+            std::env::temp_dir().join(format!("neewer-settings-{}-{name}", std::process::id()));
+        let _ = fs::remove_dir_all(&dir);
+        dir.join("settings.json")
+    }
+
+    #[test]
+    fn test_flush_round_trips() {
+        let path = temp_path("roundtrip");
+        let settings = Settings::load(path.clone());
+        settings.update(patch(json!({ "brightness": 42 })));
+        settings.update(patch(json!({ "isOn": true })));
+        assert!(!path.exists());
+        settings.flush().unwrap();
+
+        let reloaded = Settings::load(path.clone()).get_all();
+        assert_eq!(reloaded, patch(json!({ "brightness": 42, "isOn": true })));
+        assert!(!path.with_extension("json.tmp").exists());
+    }
+
+    #[test]
+    fn test_unchanged_values_stay_clean() {
+        let settings = Settings::load(temp_path("clean"));
+        settings.update(patch(json!({ "kelvin": 4950 })));
+        settings.flush().unwrap();
+        settings.update(patch(json!({ "kelvin": 4950 })));
+        assert!(settings.state.lock().unwrap().dirty.is_none());
+    }
+}
@@ -0,0 +1,99 @@
+/// Global shortcuts, registered natively at startup.
+///
+/// They are read from the panel's `shortcutConfig` setting and act directly
+/// on `LightState`, so a shortcut works from launch, before the panel webview
+/// has been created.
+use serde::{Deserialize, Serialize};
+use serde_json::Value;
+use tauri::{AppHandle, Manager};
+use tauri_plugin_global_shortcut::{GlobalShortcutExt, ShortcutState};
+
+use crate::light_state::LightState;
+use crate::settings::Settings;
+
+/// Mirrors `ShortcutConfig` in App.svelte, including its defaults.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct ShortcutConfig {
+    pub modifiers: Vec<String>,
+    pub toggle_key: String,
+    pub preset_keys: Vec<String>,
+}
+
+impl ShortcutConfig {
+    pub fn load(settings: &Settings) -> Self {
+        settings.get("shortcutConfig").unwrap_or_default()
+    }
+}
+
+impl Default for ShortcutConfig {
+    fn default() -> Self {
+        Self {
+            modifiers: vec!["CommandOrControl".into(), "Alt".into(), "Shift".into()],
+            toggle_key: "`".into(),
+            preset_keys: ["1", "2", "3", "4"].map(String::from).to_vec(),
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy)]
+enum Action {
+    Toggle,
+    Preset(usize),
+}
+
+/// Replace all registered shortcuts with the ones in the current settings.
+/// A key that fails to parse or is taken is reported; the rest still work.
+pub fn register(app: &AppHandle) -> Result<(), String> {
+    let settings = app.state::<Settings>();
+    let config = ShortcutConfig::load(&settings);
+    let presets = settings.get::<Vec<Value>>("presets").map_or(0, |p| p.len());
+
+    let shortcuts = app.global_shortcut();
+    shortcuts
+        .unregister_all()
+        .map_err(|e| format!("Failed to unregister shortcuts: {e}"))?;
+    if config.modifiers.is_empty() {
+        return Ok(());
+    }
+
+    let accelerator = |key: &str| format!("{}+{key}", config.modifiers.join("+"));
+    let mut bindings = vec![(accelerator(&config.toggle_key), Action::Toggle)];
+    bindings.extend(
+        config
+            .preset_keys
+            .iter()
+            .take(presets)
+            .enumerate()
+            .filter(|(_, key)| !key.is_empty())
+            .map(|(i, key)| (accelerator(key), Action::Preset(i))),
+    );
+
+    let mut failed = Vec::new();
+    for (accelerator, action) in bindings {
+        let registered = shortcuts.on_shortcut(accelerator.as_str(), move |app, _, event| {
+            if event.state() == ShortcutState::Pressed {
+                run(app, action);
+            }
+        });
+        if let Err(e) = registered {
+            failed.push(format!("{accelerator} ({e})"));
+        }
+    }
+    if !failed.is_empty() {
+        return Err(format!("Failed to register {}", failed.join(", ")));
+    }
+    Ok(())
+}
+
+fn run(app: &AppHandle, action: Action) {
+    let light = app.state::<LightState>();
+    match action {
+        Action::Toggle => {
+            light.toggle(app);
+        }
+        Action::Preset(i) => {
+            let _ = light.apply_preset(app, i);
+        }
+    }
+}
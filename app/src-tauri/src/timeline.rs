@@ -0,0 +1,465 @@
+/// Precompiled light-show timelines.
+///
+/// A cue file is compiled once into a flat binary: a header, a table of
+/// per-light tracks, then fixed-size keyframes of (t_us, brightness,
+/// temp_byte). Kelvin is quantized with `protocol::kelvin_to_byte` and fades
+/// are split into gamma-corrected ramp segments at compile time, so playback
+/// memory-maps the file and only does integer interpolation between
+/// neighbouring keyframes. A show starts in the time it takes to map it.
+///
+/// Layout (little-endian):
+///
+/// ```text
+/// header    "NWTL" | version u16 | tracks u16 | keyframes u32 | reserved u32
+/// track     id [u8; 32], NUL-padded, empty for every light | first u32 | count u32
+/// keyframe  t_us u64 | brightness u8 | temp_byte u8 | flags u8 | reserved u8
+/// ```
+use std::fs::File;
+use std::path::Path;
+use std::time::{Duration, Instant};
+
+use memmap2::Mmap;
+
+use crate::protocol::{self, CctFrame};
+use crate::transition;
+
+pub const MAGIC: &[u8; 4] = b"NWTL";
+pub const VERSION: u16 = 1;
+const HEADER_LEN: usize = 16;
+const ID_LEN: usize = 32;
+const TRACK_LEN: usize = ID_LEN + 8;
+const KEYFRAME_LEN: usize = 12;
+
+/// Keyframe flag: ramp linearly from the previous keyframe to this one.
+/// Without it the previous keyframe holds until this one's time.
+pub const RAMP: u8 = 1;
+/// Length of the linear segments a fade is split into. Short enough that
+/// the gamma curve between them isn't visible.
+const SEGMENT: Duration = Duration::from_millis(100);
+/// Longest sleep through a hold, so a stopped show exits promptly.
+const MAX_SLEEP: Duration = Duration::from_millis(100);
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Keyframe {
+    pub t_us: u64,
+    pub brightness: u8,
+    pub temp_byte: u8,
+    pub flags: u8,
+}
+
+impl Keyframe {
+    fn read(b: &[u8]) -> Self {
+        Self {
+            t_us: u64::from_le_bytes(b[..8].try_into().unwrap()),
+            brightness: b[8],
+            temp_byte: b[9],
+            flags: b[10],
+        }
+    }
+
+    fn write(&self, out: &mut Vec<u8>) {
+        out.extend_from_slice(&self.t_us.to_le_bytes());
+        out.extend_from_slice(&[self.brightness, self.temp_byte, self.flags, 0]);
+    }
+}
+
+/// A validated timeline over any byte buffer, normally a memory map.
+pub struct Timeline<B = Mmap> {
+    bytes: B,
+    tracks: usize,
+}
+
+impl Timeline {
+    pub fn open(path: &Path) -> Result<Self, String> {
+        let file =
+            File::open(path).map_err(|e| format!("Failed to open {}: {e}", path.display()))?;
+        // Only ever read. If the file is rewritten during a show, playback
+        // can at worst send wrong levels; bounds were checked below.
+        let map = unsafe { Mmap::map(&file) }
+            .map_err(|e| format!("Failed to map {}: {e}", path.display()))?;
+        Self::new(map)
+    }
+}
+
+impl<B: AsRef<[u8]>> Timeline<B> {
+    /// Check the header and that every track's keyframes are in bounds.
+    pub fn new(bytes: B) -> Result<Self, String> {
+        let b = bytes.as_ref();
+        if b.len() < HEADER_LEN || &b[..4] != MAGIC {
+            return Err("Not a timeline file".into());
+        }
+        let version = u16::from_le_bytes([b[4], b[5]]);
+        if version != VERSION {
+            return Err(format!("Unsupported timeline version {version}"));
+        }
+        let tracks = u16::from_le_bytes([b[6], b[7]]) as usize;
+        let keyframes = u32::from_le_bytes(b[8..12].try_into().unwrap()) as usize;
+        let expected = HEADER_LEN + tracks * TRACK_LEN + keyframes * KEYFRAME_LEN;
+        if b.len() != expected {
+            return Err(format!(
+                "Timeline is {} bytes, header says {expected}",
+                b.len()
+            ));
+        }
+        let timeline = Self { bytes, tracks };
+        for i in 0..tracks {
+            let (first, count) = timeline.range(i);
+            if first.checked_add(count).map_or(true, |end| end > keyframes) {
+                return Err(format!("Track {} is out of bounds", i + 1));
+            }
+        }
+        Ok(timeline)
+    }
+
+    pub fn tracks(&self) -> usize {
+        self.tracks
+    }
+
+    fn track(&self, i: usize) -> &[u8] {
+        let at = HEADER_LEN + i * TRACK_LEN;
+        &self.bytes.as_ref()[at..at + TRACK_LEN]
+    }
+
+    fn range(&self, i: usize) -> (usize, usize) {
+        let t = self.track(i);
+        let first = u32::from_le_bytes(t[ID_LEN..ID_LEN + 4].try_into().unwrap());
+        let count = u32::from_le_bytes(t[ID_LEN + 4..].try_into().unwrap());
+        (first as usize, count as usize)
+    }
+
+    /// Light id the track drives, or None for every light.
+    pub fn light(&self, i: usize) -> Option<&str> {
+        let id = &self.track(i)[..ID_LEN];
+        let len = id.iter().position(|&b| b == 0).unwrap_or(ID_LEN);
+        std::str::from_utf8(&id[..len])
+            .ok()
+            .filter(|s| !s.is_empty())
+    }
+
+    fn keyframe(&self, track: usize, k: usize) -> Keyframe {
+        let (first, _) = self.range(track);
+        let at = HEADER_LEN + self.tracks * TRACK_LEN + (first + k) * KEYFRAME_LEN;
+        Keyframe::read(&self.bytes.as_ref()[at..at + KEYFRAME_LEN])
+    }
+
+    /// Play from the start, calling `send(track, frame)` whenever a track's
+    /// frame changes, until every track has reached its last keyframe or
+    /// `running` returns false. Returns each track's last frame sent.
+    pub fn play(
+        &self,
+        mut running: impl FnMut() -> bool,
+        mut send: impl FnMut(usize, CctFrame),
+    ) -> Vec<Option<CctFrame>> {
+        let start = Instant::now();
+        let mut cursors = vec![Cursor::default(); self.tracks];
+        loop {
+            if !running() {
+                break;
+            }
+            let now_us = start.elapsed().as_micros() as u64;
+            let mut wake_us = u64::MAX;
+            let mut done = true;
+            for (i, cursor) in cursors.iter_mut().enumerate() {
+                let step = cursor.step(self, i, now_us);
+                if let Some(frame) = step.frame {
+                    if cursor.sent != Some(frame) {
+                        cursor.sent = Some(frame);
+                        send(i, frame);
+                    }
+                }
+                done &= step.wake_us.is_none();
+                wake_us = wake_us.min(step.wake_us.unwrap_or(u64::MAX));
+            }
+            if done {
+                break;
+            }
+            // Sleep to the next keyframe, or one fade step while ramping.
+            let now = Instant::now();
+            let wake = (start + Duration::from_micros(wake_us)).min(now + MAX_SLEEP);
+            if wake > now {
+                std::thread::sleep(wake - now);
+            }
+        }
+        cursors.into_iter().map(|c| c.sent).collect()
+    }
+}
+
+#[derive(Clone, Copy, Default)]
+struct Cursor {
+    /// Keyframes of the track already reached.
+    reached: usize,
+    sent: Option<CctFrame>,
+}
+
+struct Step {
+    frame: Option<CctFrame>,
+    /// When this track next needs a look, or None once it is finished.
+    wake_us: Option<u64>,
+}
+
+impl Cursor {
+    fn step<B: AsRef<[u8]>>(&mut self, timeline: &Timeline<B>, track: usize, now_us: u64) -> Step {
+        let (_, count) = timeline.range(track);
+        while self.reached < count && timeline.keyframe(track, self.reached).t_us <= now_us {
+            self.reached += 1;
+        }
+        if self.reached == count {
+            let frame = (count > 0).then(|| frame(timeline.keyframe(track, count - 1)));
+            return Step {
+                frame,
+                wake_us: None,
+            };
+        }
+        let next = timeline.keyframe(track, self.reached);
+        if self.reached == 0 {
+            return Step {
+                frame: None,
+                wake_us: Some(next.t_us),
+            };
+        }
+        let prev = timeline.keyframe(track, self.reached - 1);
+        if next.flags & RAMP == 0 {
+            return Step {
+                frame: Some(frame(prev)),
+                wake_us: Some(next.t_us),
+            };
+        }
+        let lerp = |a: u8, b: u8| {
+            let span = (next.t_us - prev.t_us) as i64;
+            let at = (now_us - prev.t_us) as i64;
+            (a as i64 + (b as i64 - a as i64) * at / span) as u8
+        };
+        let step_us = transition::STEP_INTERVAL.as_micros() as u64;
+        Step {
+            frame: Some(protocol::cct_command_raw(
+                lerp(prev.brightness, next.brightness),
+                lerp(prev.temp_byte, next.temp_byte),
+            )),
+            wake_us: Some((now_us + step_us).min(next.t_us)),
+        }
+    }
+}
+
+fn frame(k: Keyframe) -> CctFrame {
+    protocol::cct_command_raw(k.brightness, k.temp_byte)
+}
+
+/// Compile a cue file into a timeline.
+///
+/// Cues use the CLI's format, grouped into tracks by `[<light id>]` lines
+/// (ids as `list_lights` reports them); cues before the first header, or
+/// under `[all]`, drive every light:
+///
+/// ```text
+/// # <time s> <brightness 0-100> [kelvin] [fade <seconds>]
+/// [all]
+/// 0.0  100 4950
+/// 4.0  10  2900 fade 1.5
+/// ```
+pub fn compile(source: &str) -> Result<Vec<u8>, String> {
+    let mut tracks: Vec<(String, Vec<Keyframe>)> = Vec::new();
+    let mut kelvin = 4950;
+    let mut last = None;
+    for (n, line) in source.lines().enumerate() {
+        let n = n + 1;
+        let line = line.split('#').next().unwrap_or_default().trim();
+        if line.is_empty() {
+            continue;
+        }
+        if let Some(id) = line.strip_prefix('[').and_then(|l| l.strip_suffix(']')) {
+            let id = if id == "all" { "" } else { id.trim() };
+            if id.len() > ID_LEN {
+                return Err(format!("line {n}: light id is over {ID_LEN} bytes"));
+            }
+            if tracks.iter().any(|(t, _)| t == id) {
+                return Err(format!("line {n}: track [{id}] appears twice"));
+            }
+            tracks.push((id.to_string(), Vec::new()));
+            kelvin = 4950;
+            last = None;
+            continue;
+        }
+        if tracks.is_empty() {
+            tracks.push((String::new(), Vec::new()));
+        }
+        let keyframes = &mut tracks.last_mut().unwrap().1;
+        let cue = Cue::parse(line, kelvin).map_err(|e| format!("line {n}: {e}"))?;
+        kelvin = cue.kelvin;
+        if keyframes
+            .last()
+            .is_some_and(|k: &Keyframe| cue.t_us < k.t_us)
+        {
+            return Err(format!("line {n}: cue starts before the previous one ends"));
+        }
+        cue.compile(last, keyframes);
+        last = Some(cue);
+    }
+
+    let keyframes: usize = tracks.iter().map(|(_, k)| k.len()).sum();
+    if tracks.len() > u16::MAX as usize || keyframes > u32::MAX as usize {
+        return Err("Timeline is too large".into());
+    }
+    let mut out =
+        Vec::with_capacity(HEADER_LEN + tracks.len() * TRACK_LEN + keyframes * KEYFRAME_LEN);
+    out.extend_from_slice(MAGIC);
+    out.extend_from_slice(&VERSION.to_le_bytes());
+    out.extend_from_slice(&(tracks.len() as u16).to_le_bytes());
+    out.extend_from_slice(&(keyframes as u32).to_le_bytes());
+    out.extend_from_slice(&[0; 4]);
+    let mut first = 0u32;
+    for (id, keyframes) in &tracks {
+        let mut padded = [0u8; ID_LEN];
+        padded[..id.len()].copy_from_slice(id.as_bytes());
+        out.extend_from_slice(&padded);
+        out.extend_from_slice(&first.to_le_bytes());
+        out.extend_from_slice(&(keyframes.len() as u32).to_le_bytes());
+        first += keyframes.len() as u32;
+    }
+    for keyframe in tracks.iter().flat_map(|(_, k)| k) {
+        keyframe.write(&mut out);
+    }
+    Ok(out)
+}
+
+#[derive(Debug, Clone, Copy)]
+struct Cue {
+    t_us: u64,
+    brightness: u8,
+    kelvin: u32,
+    fade_us: u64,
+}
+
+impl Cue {
+    fn parse(line: &str, prev_kelvin: u32) -> Result<Self, String> {
+        let usage = || "expected '<time> <brightness> [kelvin] [fade <seconds>]'".to_string();
+        let seconds = |w: &str| -> Result<u64, String> {
+            let s: f64 = w.parse().map_err(|_| usage())?;
+            if !(s >= 0.0 && s.is_finite()) {
+                return Err(format!("bad time: {w}"));
+            }
+            Ok((s * 1e6).round() as u64)
+        };
+        let mut words: Vec<&str> = line.split_whitespace().collect();
+        let mut fade_us = 0;
+        if words.len() >= 2 && words[words.len() - 2] == "fade" {
+            fade_us = seconds(words[words.len() - 1])?;
+            words.truncate(words.len() - 2);
+        }
+        let (t, brightness, kelvin) = match words[..] {
+            [t, b] => (t, b, None),
+            [t, b, k] => (t, b, Some(k)),
+            _ => return Err(usage()),
+        };
+        Ok(Self {
+            t_us: seconds(t)?,
+            brightness: brightness.parse::<u8>().map_err(|_| usage())?.min(100),
+            kelvin: match kelvin {
+                Some(k) => k.parse().map_err(|_| usage())?,
+                None => prev_kelvin,
+            },
+            fade_us,
+        })
+    }
+
+    /// Append this cue's keyframes. A fade ramps from `prev`, in slider space
+    /// so it follows the panel's gamma curve, one linear segment per
+    /// `SEGMENT`.
+    fn compile(&self, prev: Option<Cue>, out: &mut Vec<Keyframe>) {
+        let target = Keyframe {
+            t_us: self.t_us + self.fade_us,
+            brightness: self.brightness,
+            temp_byte: protocol::kelvin_to_byte(self.kelvin),
+            flags: 0,
+        };
+        let Some(prev) = prev.filter(|_| self.fade_us > 0) else {
+            out.push(target);
+            return;
+        };
+        // Hold the previous level until the fade starts.
+        out.push(Keyframe {
+            t_us: self.t_us,
+            brightness: prev.brightness,
+            temp_byte: protocol::kelvin_to_byte(prev.kelvin),
+            flags: 0,
+        });
+        let slider = |hw: u8| (hw as f64 / 100.0).powf(1.0 / transition::BRI_GAMMA) * 100.0;
+        let (s0, s1) = (slider(prev.brightness), slider(self.brightness));
+        let (k0, k1) = (prev.kelvin as f64, self.kelvin as f64);
+        let segments = self.fade_us.div_ceil(SEGMENT.as_micros() as u64);
+        for i in 1..=segments {
+            let t = i as f64 / segments as f64;
+            out.push(Keyframe {
+                t_us: self.t_us + self.fade_us * i / segments,
+                brightness: transition::slider_to_hw(s0 + (s1 - s0) * t),
+                temp_byte: protocol::kelvin_to_byte((k0 + (k1 - k0) * t).round() as u32),
+                flags: RAMP,
+            });
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn keyframes(timeline: &Timeline<Vec<u8>>, track: usize) -> Vec<Keyframe> {
+        let (_, count) = timeline.range(track);
+        (0..count).map(|k| timeline.keyframe(track, k)).collect()
+    }
+
+    #[test]
+    fn test_compile_round_trips() {
+        let source = "\
+            0 100 2900\n\
+            [light-2]\n\
+            0.5 40 # comment\n\
+            1.0 0 7000 fade 0.25\n";
+        let timeline = Timeline::new(compile(source).unwrap()).unwrap();
+        assert_eq!(timeline.tracks(), 2);
+        assert_eq!(timeline.light(0), None);
+        assert_eq!(timeline.light(1), Some("light-2"));
+
+        assert_eq!(
+            keyframes(&timeline, 0),
+            vec![Keyframe {
+                t_us: 0,
+                brightness: 100,
+                temp_byte: 0,
+                flags: 0
+            }]
+        );
+        let fade = keyframes(&timeline, 1);
+        // Cue, hold until the fade, then three 100 ms (or shorter) segments.
+        assert_eq!(fade.len(), 5);
+        assert_eq!(fade[1].t_us, 1_000_000);
+        assert_eq!((fade[1].brightness, fade[1].temp_byte), (40, 9));
+        assert!(fade[2..].iter().all(|k| k.flags == RAMP));
+        let end = fade.last().unwrap();
+        assert_eq!(
+            (end.t_us, end.brightness, end.temp_byte),
+            (1_250_000, 0, 18)
+        );
+    }
+
+    #[test]
+    fn test_rejects_bad_input() {
+        assert!(compile("1.0 50\n0.5 50\n").is_err());
+        assert!(compile("0 50 fade\n").is_err());
+        assert!(compile("[a]\n[a]\n").is_err());
+        assert!(Timeline::new(b"NWTL".to_vec()).is_err());
+        let mut bytes = compile("0 50\n").unwrap();
+        bytes.pop();
+        assert!(Timeline::new(bytes).is_err());
+    }
+
+    #[test]
+    fn test_play_steps_and_ramps() {
+        let timeline = Timeline::new(compile("0 0 2900\n0 100 2900 fade 0.04\n").unwrap()).unwrap();
+        let mut frames = Vec::new();
+        let last = timeline.play(|| true, |_, frame| frames.push(frame));
+        assert_eq!(frames.first(), Some(&protocol::cct_command(0, 2900)));
+        assert_eq!(frames.last(), Some(&protocol::cct_command(100, 2900)));
+        assert!(frames.windows(2).all(|w| w[0] != w[1]));
+        assert_eq!(last, vec![frames.last().copied()]);
+    }
+}
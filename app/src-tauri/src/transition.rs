@@ -0,0 +1,434 @@
+/// Backend fades between light states.
+///
+/// A fade runs on its own thread and steps on a fixed monotonic schedule,
+/// posting a CCT frame to the writers whenever the quantized state changes.
+/// The frontend makes one `fade_to` call instead of driving the fade over
+/// IPC, so webview timer jitter never reaches the light.
+///
+/// Brightness is interpolated in slider space and mapped through the same
+/// gamma curve the panel uses (`sliderToHw` in App.svelte), so a fade looks
+/// perceptually even.
+use std::sync::{
+    atomic::{AtomicU64, Ordering},
+    Arc, Mutex,
+};
+use std::time::{Duration, Instant};
+
+use serde::{Deserialize, Serialize};
+use tauri::{AppHandle, Manager};
+
+use crate::fleet::Fleet;
+use crate::protocol::{self, Cct};
+use crate::serial::Priority;
+use crate::timeline::Timeline;
+
+/// Gamma between slider position and hardware brightness (see App.svelte).
+/// The tables and `slider_to_hw` below are written for exactly 2.
+pub const BRI_GAMMA: f64 = 2.0;
+
+/// Hardware brightness for each whole slider position: round(s² / 100).
+pub const SLIDER_TO_HW: [u8; 101] = {
+    let mut table = [0; 101];
+    let mut s = 0;
+    while s < table.len() {
+        table[s] = ((s * s + 50) / 100) as u8;
+        s += 1;
+    }
+    table
+};
+
+/// Slider position for each hardware brightness: round(10·√hw).
+pub const HW_TO_SLIDER: [u8; 101] = {
+    let mut table = [0; 101];
+    let mut hw = 0;
+    while hw < table.len() {
+        // Largest s with s² <= 100·hw, then round up when (s + ½)² <= 100·hw,
+        // i.e. s² + s < 100·hw (there are no exact halves).
+        let n = 100 * hw;
+        let mut s = 0;
+        while (s + 1) * (s + 1) <= n {
+            s += 1;
+        }
+        table[hw] = (if s * s + s < n { s + 1 } else { s }) as u8;
+        hw += 1;
+    }
+    table
+};
+
+/// The conversion tables, sent to the panel once at startup so its
+/// reactive previews do lookups instead of `Math.pow`.
+#[derive(Debug, Clone, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct ConversionTables {
+    pub slider_to_hw: &'static [u8],
+    pub hw_to_slider: &'static [u8],
+    /// Kelvin of each temperature byte.
+    pub kelvin_steps: &'static [u32],
+}
+
+pub const TABLES: ConversionTables = ConversionTables {
+    slider_to_hw: &SLIDER_TO_HW,
+    hw_to_slider: &HW_TO_SLIDER,
+    kelvin_steps: &protocol::KELVIN_STEPS,
+};
+
+/// One 8-byte frame at 115200 baud, 8N1 (10 bits per byte): ~694 µs.
+pub const FRAME_TIME: Duration = Duration::from_micros(8 * 10 * 1_000_000 / 115_200);
+
+/// Fade step interval. A few frame times per step keeps every step well
+/// inside the line's capacity, with room left for the light's echoes.
+pub const STEP_INTERVAL: Duration = Duration::from_micros(4 * FRAME_TIME.as_micros() as u64);
+
+/// Slider position (0-100) to hardware brightness (0-100). Fades pass
+/// fractional positions, so this squares rather than looking up.
+pub fn slider_to_hw(slider: f64) -> u8 {
+    let s = slider.clamp(0.0, 100.0) / 100.0;
+    (s * s * 100.0).round() as u8
+}
+
+/// Hardware brightness (0-100) to the nearest whole slider position.
+pub fn hw_to_slider(hw: u8) -> f64 {
+    HW_TO_SLIDER[hw.min(100) as usize] as f64
+}
+
+#[derive(Debug, Clone, Copy, Default, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub enum Curve {
+    #[default]
+    Linear,
+    EaseIn,
+    EaseOut,
+    EaseInOut,
+}
+
+impl Curve {
+    /// Map linear progress 0..=1 to eased progress 0..=1.
+    pub fn apply(self, t: f64) -> f64 {
+        let t = t.clamp(0.0, 1.0);
+        match self {
+            Curve::Linear => t,
+            Curve::EaseIn => t * t,
+            Curve::EaseOut => 1.0 - (1.0 - t) * (1.0 - t),
+            Curve::EaseInOut => t * t * (3.0 - 2.0 * t),
+        }
+    }
+}
+
+/// A light state in fade space: slider brightness and Kelvin.
+#[derive(Debug, Clone, Copy, PartialEq)]
+struct Point {
+    slider: f64,
+    kelvin: f64,
+}
+
+impl Point {
+    fn lerp(self, to: Point, t: f64) -> Point {
+        Point {
+            slider: self.slider + (to.slider - self.slider) * t,
+            kelvin: self.kelvin + (to.kelvin - self.kelvin) * t,
+        }
+    }
+
+    fn cct(self) -> Cct {
+        Cct::new(slider_to_hw(self.slider), self.kelvin.round() as u32)
+    }
+}
+
+pub struct TransitionEngine {
+    /// Bumped by every new fade or direct set; a running fade exits as soon
+    /// as it sees a generation that isn't its own.
+    generation: Arc<AtomicU64>,
+    /// Last state commanded, where the next fade starts from. Fades and
+    /// timelines post each step under this lock, and `set` and `stop` bump
+    /// the generation under it, so no step can be posted after they return.
+    current: Arc<Mutex<Option<Point>>>,
+}
+
+impl TransitionEngine {
+    pub fn new() -> Self {
+        Self {
+            generation: Arc::new(AtomicU64::new(0)),
+            current: Arc::new(Mutex::new(None)),
+        }
+    }
+
+    /// Cancel any running fade and record a state set directly.
+    pub fn set(&self, hw_brightness: u8, kelvin: u32) {
+        let mut current = self.current.lock().unwrap();
+        self.generation.fetch_add(1, Ordering::SeqCst);
+        *current = Some(Point {
+            slider: hw_to_slider(hw_brightness),
+            kelvin: kelvin as f64,
+        });
+    }
+
+    /// Cancel any running fade or timeline.
+    pub fn stop(&self) {
+        let _current = self.current.lock().unwrap();
+        self.generation.fetch_add(1, Ordering::SeqCst);
+    }
+
+    /// Play `timeline` from the start, replacing any running fade. Tracks
+    /// for lights that aren't connected are skipped.
+    pub fn play(&self, app: AppHandle, timeline: Timeline) {
+        let gen = self.generation.fetch_add(1, Ordering::SeqCst) + 1;
+        let generation = self.generation.clone();
+        let current = self.current.clone();
+
+        std::thread::spawn(move || {
+            raise_thread_priority();
+            let fleet = app.state::<Fleet>();
+            let targets: Vec<Option<[String; 1]>> = (0..timeline.tracks())
+                .map(|i| timeline.light(i).map(|id| [id.to_string()]))
+                .collect();
+            let last = timeline.play(
+                || generation.load(Ordering::SeqCst) == gen,
+                |track, frame| {
+                    let _current = current.lock().unwrap();
+                    if generation.load(Ordering::SeqCst) != gen {
+                        return;
+                    }
+                    // Compiled timelines hold PL81-Pro temperature steps.
+                    let cct = Cct::new(frame[4], protocol::byte_to_kelvin(frame[5]));
+                    let _ = match &targets[track] {
+                        Some(id) => fleet.submit_group(id, cct, Priority::Background),
+                        None => fleet.submit_all(cct, Priority::Background),
+                    };
+                },
+            );
+            // The next fade starts where the fleet-wide track left off.
+            let fleet_wide = targets.iter().position(Option::is_none);
+            if let Some(frame) = fleet_wide.and_then(|i| last[i]) {
+                let mut current = current.lock().unwrap();
+                if generation.load(Ordering::SeqCst) == gen {
+                    *current = Some(Point {
+                        slider: hw_to_slider(frame[4]),
+                        kelvin: protocol::byte_to_kelvin(frame[5]) as f64,
+                    });
+                }
+            }
+        });
+    }
+
+    /// Start fading from the last commanded state to `brightness` (slider
+    /// units, 0-100) and `kelvin` over `duration`. Replaces any running fade.
+    /// `ids` limits the fade to some lights; `None` fades the whole fleet.
+    pub fn fade_to(
+        &self,
+        app: AppHandle,
+        brightness: f64,
+        kelvin: u32,
+        duration: Duration,
+        curve: Curve,
+        ids: Option<Vec<String>>,
+    ) {
+        let gen = self.generation.fetch_add(1, Ordering::SeqCst) + 1;
+        let target = Point {
+            slider: brightness.clamp(0.0, 100.0),
+            kelvin: kelvin.clamp(protocol::TEMP_MIN_K, protocol::TEMP_MAX_K) as f64,
+        };
+        let from = self.current.lock().unwrap().unwrap_or(target);
+        let generation = self.generation.clone();
+        let current = self.current.clone();
+
+        std::thread::spawn(move || {
+            raise_thread_priority();
+            let fleet = app.state::<Fleet>();
+            let send = |cct: Cct| match &ids {
+                Some(ids) => fleet.submit_group(ids, cct, Priority::Background),
+                None => fleet.submit_all(cct, Priority::Background),
+            };
+            run_fade(from, target, duration, curve, &generation, gen, |point| {
+                // A `set` or newer fade may have won since run_fade's check.
+                let mut current = current.lock().unwrap();
+                if generation.load(Ordering::SeqCst) != gen {
+                    return None;
+                }
+                *current = Some(point);
+                send(point.cct()).ok().map(|_| fleet.send_interval())
+            });
+        });
+    }
+}
+
+/// Step from `from` to `to` until done or superseded.
+/// `step` is called with each new point whose state differs from the last
+/// one sent; each light's link drops the ones its model can't tell apart.
+/// It returns the gap the lights currently need between frames, which
+/// stretches the schedule past `STEP_INTERVAL` on a slow link, or
+/// None to abort (e.g. every light disconnected).
+fn run_fade(
+    from: Point,
+    to: Point,
+    duration: Duration,
+    curve: Curve,
+    generation: &AtomicU64,
+    gen: u64,
+    mut step: impl FnMut(Point) -> Option<Duration>,
+) {
+    let start = Instant::now();
+    let mut last_cct = None;
+    let mut interval = STEP_INTERVAL;
+    let mut deadline = start;
+
+    loop {
+        if generation.load(Ordering::SeqCst) != gen {
+            return;
+        }
+        let elapsed = start.elapsed();
+        let t = if duration.is_zero() {
+            1.0
+        } else {
+            elapsed.as_secs_f64() / duration.as_secs_f64()
+        };
+        let point = from.lerp(to, curve.apply(t));
+        let cct = point.cct();
+        if last_cct != Some(cct) {
+            last_cct = Some(cct);
+            match step(point) {
+                Some(gap) => interval = gap.max(STEP_INTERVAL),
+                None => return,
+            }
+        }
+        if t >= 1.0 {
+            return;
+        }
+
+        // Sleep to the next absolute deadline so scheduling error never
+        // accumulates across steps.
+        deadline += interval;
+        let now = Instant::now();
+        if deadline > now {
+            std::thread::sleep(deadline - now);
+        }
+    }
+}
+
+/// Ask the OS to schedule the fade thread like UI work.
+fn raise_thread_priority() {
+    #[cfg(target_os = "macos")]
+    unsafe {
+        libc::pthread_set_qos_class_self_np(libc::qos_class_t::QOS_CLASS_USER_INTERACTIVE, 0);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_gamma_matches_frontend() {
+        // Math.round(Math.pow(50 / 100, 2) * 100) === 25
+        assert_eq!(slider_to_hw(50.0), 25);
+        assert_eq!(slider_to_hw(100.0), 100);
+        assert_eq!(slider_to_hw(0.0), 0);
+        assert_eq!(hw_to_slider(25), 50.0);
+        assert_eq!(hw_to_slider(100), 100.0);
+    }
+
+    #[test]
+    fn test_tables_match_gamma_curve() {
+        for i in 0..=100u8 {
+            let x = i as f64 / 100.0;
+            let hw = (x.powf(BRI_GAMMA) * 100.0).round() as u8;
+            let slider = (x.powf(1.0 / BRI_GAMMA) * 100.0).round() as u8;
+            assert_eq!(SLIDER_TO_HW[i as usize], hw, "slider {i}");
+            assert_eq!(slider_to_hw(i as f64), hw, "slider {i}");
+            assert_eq!(HW_TO_SLIDER[i as usize], slider, "hw {i}");
+        }
+    }
+
+    #[test]
+    fn test_curves_hit_endpoints() {
+        for curve in [
+            Curve::Linear,
+            Curve::EaseIn,
+            Curve::EaseOut,
+            Curve::EaseInOut,
+        ] {
+            assert_eq!(curve.apply(0.0), 0.0);
+            assert_eq!(curve.apply(1.0), 1.0);
+        }
+    }
+
+    #[test]
+    fn test_fade_sends_distinct_frames_and_ends_on_target() {
+        let from = Point {
+            slider: 0.0,
+            kelvin: 2900.0,
+        };
+        let to = Point {
+            slider: 100.0,
+            kelvin: 7000.0,
+        };
+        let generation = AtomicU64::new(1);
+        let mut frames = Vec::new();
+        run_fade(
+            from,
+            to,
+            Duration::from_millis(50),
+            Curve::Linear,
+            &generation,
+            1,
+            |p| {
+                frames.push(p.cct());
+                Some(STEP_INTERVAL)
+            },
+        );
+        assert_eq!(frames.first(), Some(&from.cct()));
+        assert_eq!(frames.last(), Some(&to.cct()));
+        assert!(frames.windows(2).all(|w| w[0] != w[1]));
+    }
+
+    #[test]
+    fn test_fade_slows_to_link_rate() {
+        let from = Point {
+            slider: 0.0,
+            kelvin: 2900.0,
+        };
+        let to = Point {
+            slider: 100.0,
+            kelvin: 7000.0,
+        };
+        let generation = AtomicU64::new(1);
+        let mut frames = Vec::new();
+        run_fade(
+            from,
+            to,
+            Duration::from_millis(50),
+            Curve::Linear,
+            &generation,
+            1,
+            |p| {
+                frames.push(p.cct());
+                Some(Duration::from_millis(20))
+            },
+        );
+        // 0, 20, 40 and the end point at 60 ms.
+        assert!(frames.len() <= 4);
+        assert_eq!(frames.last(), Some(&to.cct()));
+    }
+
+    #[test]
+    fn test_superseded_fade_stops() {
+        let generation = AtomicU64::new(2);
+        let mut steps = 0;
+        let p = Point {
+            slider: 0.0,
+            kelvin: 2900.0,
+        };
+        run_fade(
+            p,
+            p,
+            Duration::from_secs(10),
+            Curve::Linear,
+            &generation,
+            1,
+            |_| {
+                steps += 1;
+                Some(STEP_INTERVAL)
+            },
+        );
+        assert_eq!(steps, 0);
+    }
+}
@@ -0,0 +1,268 @@
+/// UDP endpoint for lighting consoles and show-control software (opt-in).
+///
+/// A sender streams state at frame rate, so each datagram carries a whole
+/// batch of lights and there is no reply. Entries post straight into each
+/// light's mailbox, where the latest state wins; bursts faster than a link
+/// can take coalesce there. Datagrams are read into one reused buffer and
+/// parsed in place, so a message costs no allocation.
+///
+/// ```text
+/// "NWL1" <seq u32> { <id len u8> <id> <brightness u8> <kelvin u16> }...
+/// ```
+///
+/// Integers are big-endian. Brightness is the hardware percentage and an
+/// empty id means every light. A datagram is applied whole or not at all,
+/// and one older than the last from the same sender (by `seq`) is dropped.
+///
+/// Off unless `$NEEWER_UDP` or the `udpListen` setting gives an address,
+/// such as `0.0.0.0:7770`: anyone who can reach the port drives the lights.
+use std::io::{self, ErrorKind};
+use std::net::{SocketAddr, UdpSocket};
+use std::time::{Duration, Instant};
+
+use tauri::{AppHandle, Manager};
+
+use crate::fleet::Fleet;
+use crate::protocol::Cct;
+use crate::serial::Priority;
+use crate::settings::Settings;
+use crate::transition::TransitionEngine;
+
+const MAGIC: &[u8; 4] = b"NWL1";
+/// Largest UDP payload.
+const MAX_DATAGRAM: usize = 65_507;
+/// A sender silent this long may start over from any `seq`.
+const SEQ_RESET: Duration = Duration::from_secs(1);
+/// First wait after a receive error that isn't transient, doubled up to
+/// `MAX_BACKOFF` while it keeps failing.
+const MIN_BACKOFF: Duration = Duration::from_millis(10);
+const MAX_BACKOFF: Duration = Duration::from_secs(1);
+
+/// One light's new state, borrowed from the datagram.
+#[derive(Debug, Clone, Copy, PartialEq)]
+struct Entry<'a> {
+    /// None for every light.
+    id: Option<&'a str>,
+    brightness: u8,
+    kelvin: u32,
+}
+
+/// The entries of a datagram whose header has been checked.
+#[derive(Clone)]
+struct Entries<'a>(&'a [u8]);
+
+impl<'a> Iterator for Entries<'a> {
+    type Item = Result<Entry<'a>, &'static str>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let (&len, rest) = self.0.split_first()?;
+        let len = len as usize;
+        let Some((id, [brightness, hi, lo])) = rest.get(..len + 3).map(|e| e.split_at(len)) else {
+            self.0 = &[];
+            return Some(Err("truncated entry"));
+        };
+        let Ok(id) = std::str::from_utf8(id) else {
+            self.0 = &[];
+            return Some(Err("light id is not UTF-8"));
+        };
+        self.0 = &rest[len + 3..];
+        Some(Ok(Entry {
+            id: (!id.is_empty()).then_some(id),
+            brightness: (*brightness).min(100),
+            kelvin: u16::from_be_bytes([*hi, *lo]) as u32,
+        }))
+    }
+}
+
+/// Check a datagram's header and every entry. Returns its sequence number
+/// and entries.
+fn parse(datagram: &[u8]) -> Result<(u32, Entries<'_>), &'static str> {
+    let body = datagram
+        .strip_prefix(MAGIC)
+        .ok_or("not a light state datagram")?;
+    let (seq, entries) = body.split_first_chunk::<4>().ok_or("truncated header")?;
+    let entries = Entries(entries);
+    if let Some(Err(e)) = entries.clone().find(Result::is_err) {
+        return Err(e);
+    }
+    Ok((u32::from_be_bytes(*seq), entries))
+}
+
+/// Last datagram applied, to drop ones that arrive out of order.
+#[derive(Default)]
+struct Sequence {
+    last: Option<(SocketAddr, u32, Instant)>,
+}
+
+impl Sequence {
+    /// Whether a datagram numbered `seq` from `from` is newer than the last
+    /// one applied. A different or long-silent sender always is.
+    fn accept(&mut self, from: SocketAddr, seq: u32, now: Instant) -> bool {
+        let stale = self.last.is_some_and(|(addr, last, at)| {
+            addr == from && now < at + SEQ_RESET && (seq.wrapping_sub(last) as i32) <= 0
+        });
+        if !stale {
+            self.last = Some((from, seq, now));
+        }
+        !stale
+    }
+}
+
+/// Post every entry, in order, to its light's writer. Streams are paced like
+/// the app's own fades, so a change made on the panel still preempts them.
+fn apply(app: &AppHandle, entries: Entries<'_>) {
+    // The console takes over from any fade or timeline the app is running.
+    app.state::<TransitionEngine>().stop();
+    app.state::<Fleet>().submit_batch(
+        entries
+            .flatten()
+            .map(|e| (e.id, Cct::new(e.brightness, e.kelvin))),
+        Priority::Background,
+    );
+}
+
+/// Whether a receive can simply be retried. A reset or refusal is an ICMP
+/// error from an earlier send on this socket, and says nothing about it.
+fn transient(e: &io::Error) -> bool {
+    matches!(
+        e.kind(),
+        ErrorKind::ConnectionReset
+            | ErrorKind::ConnectionRefused
+            | ErrorKind::Interrupted
+            | ErrorKind::WouldBlock
+            | ErrorKind::TimedOut
+    )
+}
+
+fn serve(app: &AppHandle, socket: UdpSocket) {
+    let mut buf = vec![0u8; MAX_DATAGRAM];
+    let mut sequence = Sequence::default();
+    let mut backoff: Option<Duration> = None;
+    loop {
+        let (len, from) = match socket.recv_from(&mut buf) {
+            Ok(received) => {
+                backoff = None;
+                received
+            }
+            Err(e) if transient(&e) => continue,
+            Err(e) => {
+                // Logged once per run of failures, then retried ever more slowly.
+                let wait = match backoff {
+                    None => {
+                        eprintln!("UDP receive failed: {e}");
+                        MIN_BACKOFF
+                    }
+                    Some(wait) => (wait * 2).min(MAX_BACKOFF),
+                };
+                backoff = Some(wait);
+                std::thread::sleep(wait);
+                continue;
+            }
+        };
+        if let Ok((seq, entries)) = parse(&buf[..len]) {
+            if sequence.accept(from, seq, Instant::now()) {
+                apply(app, entries);
+            }
+        }
+    }
+}
+
+/// `$NEEWER_UDP`, or the `udpListen` setting.
+fn listen_addr(app: &AppHandle) -> Option<String> {
+    std::env::var("NEEWER_UDP")
+        .ok()
+        .or_else(|| app.state::<Settings>().get("udpListen"))
+        .filter(|addr| !addr.is_empty())
+}
+
+/// Listen on a background thread, if an address is configured.
+pub fn start(app: AppHandle) -> Result<(), String> {
+    let Some(addr) = listen_addr(&app) else {
+        return Ok(());
+    };
+    let socket = UdpSocket::bind(&addr).map_err(|e| format!("Failed to bind {addr}: {e}"))?;
+    std::thread::spawn(move || serve(&app, socket));
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const HEADER_LEN: usize = MAGIC.len() + 4;
+
+    fn datagram(seq: u32, entries: &[(&str, u8, u16)]) -> Vec<u8> {
+        let mut out = MAGIC.to_vec();
+        out.extend(seq.to_be_bytes());
+        for (id, brightness, kelvin) in entries {
+            out.push(id.len() as u8);
+            out.extend(id.as_bytes());
+            out.push(*brightness);
+            out.extend(kelvin.to_be_bytes());
+        }
+        out
+    }
+
+    #[test]
+    fn test_parse_batch() {
+        let bytes = datagram(7, &[("A1", 40, 5600), ("", 150, 2900)]);
+        let (seq, entries) = parse(&bytes).unwrap();
+        assert_eq!(seq, 7);
+        let entries: Vec<_> = entries.flatten().collect();
+        assert_eq!(
+            entries,
+            [
+                Entry {
+                    id: Some("A1"),
+                    brightness: 40,
+                    kelvin: 5600
+                },
+                Entry {
+                    id: None,
+                    brightness: 100,
+                    kelvin: 2900
+                },
+            ]
+        );
+        assert_eq!(parse(&datagram(0, &[])).unwrap().1.count(), 0);
+        assert_eq!(HEADER_LEN, datagram(0, &[]).len());
+    }
+
+    #[test]
+    fn test_parse_rejects_malformed() {
+        let bytes = datagram(1, &[("A1", 40, 5600), ("B2", 50, 4000)]);
+        // A cut-off last entry spoils the whole datagram.
+        assert!(parse(&bytes[..bytes.len() - 1]).is_err());
+        assert!(parse(&bytes[..HEADER_LEN - 1]).is_err());
+        assert!(parse(b"NWL2\0\0\0\0").is_err());
+        let mut bad_id = datagram(1, &[("A1", 40, 5600)]);
+        bad_id[HEADER_LEN + 1] = 0xFF;
+        assert!(parse(&bad_id).is_err());
+    }
+
+    #[test]
+    fn test_only_transient_errors_retry_at_once() {
+        assert!(transient(&ErrorKind::ConnectionReset.into()));
+        assert!(transient(&ErrorKind::Interrupted.into()));
+        assert!(!transient(&ErrorKind::InvalidInput.into()));
+        assert!(!transient(&io::Error::from_raw_os_error(9)));
+    }
+
+    #[test]
+    fn test_sequence_drops_reordered() {
+        let a: SocketAddr = "10.0.0.1:9000".parse().unwrap();
+        let b: SocketAddr = "10.0.0.2:9000".parse().unwrap();
+        let t0 = Instant::now();
+        let mut sequence = Sequence::default();
+        assert!(sequence.accept(a, 5, t0));
+        assert!(!sequence.accept(a, 4, t0));
+        assert!(!sequence.accept(a, 5, t0));
+        assert!(sequence.accept(a, 6, t0));
+        // Another sender takes over, and numbers wrap.
+        assert!(sequence.accept(b, u32::MAX, t0));
+        assert!(sequence.accept(b, 0, t0));
+        assert!(!sequence.accept(b, u32::MAX, t0));
+        // A sender that went quiet may have restarted from anywhere.
+        assert!(sequence.accept(b, u32::MAX, t0 + SEQ_RESET));
+    }
+}
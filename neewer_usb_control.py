@@ -6,11 +6,18 @@ Controls the Neewer PL81-Pro LED panel via USB serial (CH340).
 Protocol reverse-engineered from the NEEWER Control Center app binary.
 PL81-Pro is a bi-color (CCT-only) panel — no RGB/HSI support.
 
+While the menubar app is running, commands go through its local socket
+(the app already holds the port open) and take milliseconds. Otherwise the
+port is opened directly.
+
 Usage:
     python3 neewer_usb_control.py <brightness> [temperature_K]
     python3 neewer_usb_control.py on
     python3 neewer_usb_control.py off
     python3 neewer_usb_control.py status
+    python3 neewer_usb_control.py toggle         (app running)
+    python3 neewer_usb_control.py preset <n>     (app running)
+    python3 neewer_usb_control.py play <cue file | ->
 
 Examples:
     python3 neewer_usb_control.py 100           # 100% brightness, default 4950K
@@ -18,12 +25,15 @@ Examples:
     python3 neewer_usb_control.py 100 7000      # 100%, coolest
     python3 neewer_usb_control.py 50 4000       # 50%, warm white
     python3 neewer_usb_control.py off           # brightness 0
-    python3 neewer_usb_control.py status        # read current state
+    python3 neewer_usb_control.py status        # each light's current state
+    python3 neewer_usb_control.py play show.cue # timed cues and fades
 """
 
-import serial
 import glob
+import os
+import socket
 import sys
+import tempfile
 import time
 
 # Temperature mapping: 19 steps (0x00–0x12) across 2900K–7000K.
@@ -44,6 +54,88 @@ def byte_to_kelvin(b: int) -> int:
     return round(TEMP_MIN_K + b * (TEMP_MAX_K - TEMP_MIN_K) / TEMP_STEPS)
 
 
+# Socket served by the menubar app (see socket_path in
+# app/src-tauri/src/daemon.rs): in a directory only this user can enter.
+DAEMON_SOCKET = os.environ.get("NEEWER_SOCKET") or os.path.join(
+    os.environ.get("XDG_RUNTIME_DIR")
+    or os.path.join(tempfile.gettempdir(), f"neewer-usb-control-{os.getuid()}"),
+    "neewer-usb-control.sock",
+)
+
+
+class DaemonLink:
+    """A connection to the app's socket; one request line, one reply line."""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.replies = sock.makefile("r")
+
+    @classmethod
+    def connect(cls):
+        """Returns None if the app isn't running."""
+        try:
+            if os.stat(DAEMON_SOCKET).st_uid != os.getuid():
+                print(f"Warning: ignoring {DAEMON_SOCKET}, owned by another user")
+                return None
+        except OSError:  # not running
+            return None
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            sock.settimeout(2.0)
+            sock.connect(DAEMON_SOCKET)
+        except OSError:  # not running, or a stale socket
+            sock.close()
+            return None
+        return cls(sock)
+
+    def request(self, line: str) -> str:
+        """Returns the reply, or "" if the app went away."""
+        try:
+            self.sock.sendall(line.encode() + b"\n")
+            return self.replies.readline().strip()
+        except OSError:
+            return ""
+
+    def close(self):
+        self.replies.close()
+        self.sock.close()
+
+
+def daemon_request(line: str):
+    """Send one request to the app. Returns its reply, or None if it isn't running."""
+    link = DaemonLink.connect()
+    if link is None:
+        return None
+    reply = link.request(line)
+    link.close()
+    if not reply:
+        return None
+    if reply.startswith("err "):
+        print(f"Error: {reply[4:]}")
+        sys.exit(1)
+    return reply
+
+
+def print_reply(reply: str):
+    """Print an `ok brightness=.. kelvin=.. on=..` reply."""
+    fields = dict(f.split("=", 1) for f in reply.split()[1:])
+    state = "on" if fields["on"] == "1" else "off"
+    print(f"OK: brightness={fields['brightness']}% temp={fields['kelvin']}K ({state})")
+
+
+def print_lights(reply: str):
+    """Print an `ok <id>=<brightness>:<kelvin> ...` reply, one light per line."""
+    lights = [f.split("=", 1) for f in reply.split()[1:]]
+    if not lights:
+        print("No lights connected")
+    for light_id, state in lights:
+        if state == "?":
+            print(f"  {light_id}: not reported yet")
+        else:
+            bri, kelvin = state.split(":")
+            print(f"  {light_id}: brightness={bri}% temp={kelvin}K")
+
+
 def find_serial_port():
     ports = glob.glob("/dev/cu.usbserial-*")
     if not ports:
@@ -58,26 +150,84 @@ def usb_checksum(data: bytes) -> bytes:
     return bytes([s >> 8, s & 0xFF])
 
 
-def send_command(ser, payload: bytes, wait=0.5) -> bytes:
-    """Send command and return response (if any)."""
+# Packet framing, as in app/src-tauri/src/framing.rs
+START = 0x3A
+HEADER_LEN = 3  # prefix, tag, length
+MAX_PAYLOAD = 16  # longer is a false start
+
+
+class Framer:
+    """Incremental decoder for [0x3A][tag][len][payload][cs_hi][cs_lo].
+
+    A bad length or checksum only drops the candidate's start byte, and the
+    rest is rescanned for the next 0x3A, so the stream needn't be aligned.
+    """
+
+    def __init__(self):
+        self.buf = bytearray()
+
+    def feed(self, data: bytes) -> list:
+        """Add received bytes; return the complete packets among them."""
+        self.buf += data
+        packets = []
+        while True:
+            start = self.buf.find(START)
+            if start < 0:
+                self.buf.clear()
+                return packets
+            del self.buf[:start]
+            if len(self.buf) < HEADER_LEN:
+                return packets
+            payload_len = self.buf[2]
+            if payload_len > MAX_PAYLOAD:
+                del self.buf[:1]
+                continue
+            need = HEADER_LEN + payload_len + 2
+            if len(self.buf) < need:
+                return packets
+            packet = bytes(self.buf[:need])
+            if usb_checksum(packet[:-2]) == packet[-2:]:
+                packets.append(packet)
+                del self.buf[:need]
+            else:
+                del self.buf[:1]
+
+
+def read_packets(ser, framer: Framer, deadline: float):
+    """Yield packets as they arrive until `deadline` (time.monotonic())."""
+    while True:
+        remaining = deadline - time.monotonic()
+        if remaining <= 0:
+            return
+        ser.timeout = remaining
+        data = ser.read(max(1, ser.in_waiting))
+        yield from framer.feed(data)
+
+
+def send_command(ser, payload: bytes, timeout=0.5) -> bytes:
+    """Send command and return its echo as soon as it arrives, or b"" if it
+    doesn't within `timeout` seconds."""
     cmd = payload + usb_checksum(payload)
     ser.reset_input_buffer()
     ser.write(cmd)
     ser.flush()
-    time.sleep(wait)
-    n = ser.in_waiting
-    if n > 0:
-        return ser.read(n)
+    for packet in read_packets(ser, Framer(), time.monotonic() + timeout):
+        if packet == cmd:
+            return packet
     return b""
 
 
+def cct_payload(brightness: int, kelvin: int) -> bytes:
+    brightness = max(0, min(100, brightness))
+    return bytes([0x3A, 0x02, 0x03, 0x01, brightness, kelvin_to_byte(kelvin)])
+
+
 def set_cct(ser, brightness: int, kelvin: int = DEFAULT_TEMP_K):
     """Set CCT mode: brightness 0-100, temperature in Kelvin."""
     brightness = max(0, min(100, brightness))
     temp_byte = kelvin_to_byte(kelvin)
     actual_kelvin = byte_to_kelvin(temp_byte)
-    payload = bytes([0x3A, 0x02, 0x03, 0x01, brightness, temp_byte])
-    resp = send_command(ser, payload)
+    resp = send_command(ser, cct_payload(brightness, kelvin))
     status = "OK" if resp else "Sent (no echo)"
     print(f"{status}: brightness={brightness}% temp={actual_kelvin}K (0x{temp_byte:02x})")
 
@@ -87,17 +237,140 @@ def read_status(ser, timeout=3.0):
     print(f"Listening for status packets ({timeout}s)...")
     print("(Turn the knob on the light to trigger a status update)")
     ser.reset_input_buffer()
-    end = time.time() + timeout
-    while time.time() < end:
-        n = ser.in_waiting
-        if n >= 8:
-            data = ser.read(8)
-            if data[0] == 0x3A and data[1] == 0x02:
-                bri = data[4]
-                temp_byte = data[5]
-                kelvin = byte_to_kelvin(temp_byte)
-                print(f"  brightness={bri}% temp={kelvin}K (0x{temp_byte:02x})")
-        time.sleep(0.1)
+    for packet in read_packets(ser, Framer(), time.monotonic() + timeout):
+        if packet[1] == 0x02 and len(packet) == 8:
+            bri = packet[4]
+            temp_byte = packet[5]
+            kelvin = byte_to_kelvin(temp_byte)
+            print(f"  brightness={bri}% temp={kelvin}K (0x{temp_byte:02x})")
+
+
+# Cue files: one cue per line, times in seconds from the start of playback.
+#
+#   <time> <brightness> [kelvin] [fade <seconds>]   # comment
+#
+# A cue without a kelvin keeps the previous one. A fade runs from the
+# previous cue's levels to this one's, starting at <time>. Brightness fades
+# along the app's slider scale (hardware brightness = slider squared), so
+# equal steps look equal, as they do in the app.
+FADE_STEP = 0.02  # seconds between fade frames; time for each one's echo
+BRI_GAMMA = 2.0  # as in app/src-tauri/src/transition.rs
+
+
+def hw_to_slider(hw: int) -> float:
+    return (hw / 100) ** (1 / BRI_GAMMA) * 100
+
+
+def slider_to_hw(slider: float) -> int:
+    return round((max(0.0, min(100.0, slider)) / 100) ** BRI_GAMMA * 100)
+
+
+def parse_cues(lines):
+    """Returns [(time, brightness, kelvin, fade)], or exits on a bad line."""
+    cues = []
+    kelvin = DEFAULT_TEMP_K
+    for n, line in enumerate(lines, 1):
+        words = line.split("#", 1)[0].split()
+        if not words:
+            continue
+        try:
+            fade = 0.0
+            if len(words) >= 2 and words[-2] == "fade":
+                fade = float(words[-1])
+                words = words[:-2]
+            if len(words) not in (2, 3):
+                raise ValueError
+            t = float(words[0])
+            brightness = max(0, min(100, int(words[1])))
+            if len(words) == 3:
+                kelvin = int(words[2])
+        except ValueError:
+            print(f"Error: line {n}: expected '<time> <brightness> [kelvin] [fade <seconds>]'")
+            sys.exit(1)
+        if cues and t < cues[-1][0]:
+            print(f"Error: line {n}: cues must be in time order")
+            sys.exit(1)
+        cues.append((t, brightness, kelvin, max(0.0, fade)))
+    return cues
+
+
+def sleep_until(deadline: float):
+    remaining = deadline - time.monotonic()
+    if remaining > 0:
+        time.sleep(remaining)
+
+
+def play_cues(cues, send):
+    """Play cues on a monotonic clock. `send(brightness, kelvin, timeout)`
+    sets the light and may block up to `timeout` for its echo.
+
+    Every frame is scheduled from the start of playback, and fade frames
+    are interpolated at the time they are actually sent, so a slow echo
+    never pushes later cues back.
+    """
+    start = time.monotonic()
+    last = None
+    for t, brightness, kelvin, fade in cues:
+        at = start + t
+        sleep_until(at)
+        if fade > 0 and last is not None:
+            sent = last
+            step = 1
+            from_slider, to_slider = hw_to_slider(last[0]), hw_to_slider(brightness)
+            while True:
+                now = time.monotonic()
+                frac = min(1.0, (now - at) / fade)
+                level = (
+                    slider_to_hw(from_slider + (to_slider - from_slider) * frac),
+                    round(last[1] + (kelvin - last[1]) * frac),
+                )
+                # Kelvin snaps to the light's 19 steps; skip identical frames
+                if (level[0], kelvin_to_byte(level[1])) != (sent[0], kelvin_to_byte(sent[1])):
+                    send(level[0], level[1], FADE_STEP)
+                    sent = level
+                if frac >= 1.0:
+                    break
+                sleep_until(min(at + step * FADE_STEP, at + fade))
+                step += 1
+        else:
+            send(brightness, kelvin, 0.5)
+        last = (brightness, kelvin)
+        print(f"  {time.monotonic() - start:7.3f}s  brightness={brightness}% temp={kelvin}K")
+
+
+def play(path: str):
+    """Play a cue file (or '-' for stdin) over one connection."""
+    if path == "-":
+        cues = parse_cues(sys.stdin)
+    else:
+        with open(path) as f:
+            cues = parse_cues(f)
+    if not cues:
+        print("No cues.")
+        return
+
+    link = DaemonLink.connect()
+    if link is not None:
+        def send(brightness, kelvin, timeout):
+            reply = link.request(f"set {brightness} {kelvin}")
+            if not reply.startswith("ok"):
+                print(f"  Warning: {reply[4:] or 'app went away'}")
+
+        play_cues(cues, send)
+        link.close()
+        return
+
+    import serial
+
+    ser = serial.Serial(find_serial_port(), 115200, timeout=1)
+    time.sleep(0.2)
+    ser.read(ser.in_waiting or 0)  # drain
+
+    def send(brightness, kelvin, timeout):
+        send_command(ser, cct_payload(brightness, kelvin), timeout)
+
+    play_cues(cues, send)
+    ser.close()
 
 
 def main():
@@ -107,11 +380,48 @@ def main():
         print("  neewer_usb_control.py on")
         print("  neewer_usb_control.py off")
         print("  neewer_usb_control.py status")
+        print("  neewer_usb_control.py toggle        (app running)")
+        print("  neewer_usb_control.py preset <n>    (app running)")
+        print("  neewer_usb_control.py play <cue file | ->")
         print()
         print(f"  Temperature: {TEMP_MIN_K}K–{TEMP_MAX_K}K (default {DEFAULT_TEMP_K}K)")
         sys.exit(1)
 
     cmd = sys.argv[1].lower()
+
+    if cmd == "play":
+        play(sys.argv[2] if len(sys.argv) > 2 else "-")
+        return
+
+    if cmd == "on":
+        request = f"set 100 {DEFAULT_TEMP_K}"
+    elif cmd == "off":
+        request = f"set 0 {DEFAULT_TEMP_K}"
+    elif cmd.isdigit():
+        kelvin = sys.argv[2] if len(sys.argv) > 2 else DEFAULT_TEMP_K
+        request = f"set {min(100, int(cmd))} {kelvin}"
+    elif cmd == "status":
+        request = "lights"  # the app follows echoes and knob turns itself
+    elif cmd == "toggle":
+        request = cmd
+    elif cmd == "preset" and len(sys.argv) > 2:
+        request = f"preset {sys.argv[2]}"
+    else:
+        request = None
+
+    reply = daemon_request(request) if request else None
+    if reply:
+        if cmd == "status":
+            print_lights(reply)
+        else:
+            print_reply(reply)
+        return
+    if cmd in ("toggle", "preset"):
+        print(f"Error: '{cmd}' needs the menubar app running")
+        sys.exit(1)
+
+    import serial
+
     port = find_serial_port()
     ser = serial.Serial(port, 115200, timeout=1)
     time.sleep(0.2)
@@ -12,34 +12,17 @@ Usage:
 """
 
 import serial
-import glob
-import sys
 import time
 import json
 
-
-def find_serial_port():
-    ports = glob.glob("/dev/cu.usbserial-*")
-    if not ports:
-        print("Error: No USB serial port found. Is the light connected?")
-        sys.exit(1)
-    return ports[0]
-
-
-def usb_checksum(data: bytes) -> bytes:
-    s = sum(data) & 0xFFFF
-    return bytes([s >> 8, s & 0xFF])
+from neewer_usb_control import find_serial_port, send_command
 
 
 def set_temp(ser, temp_byte, brightness=100):
+    """Returns as soon as the light echoes the command."""
     brightness = max(0, min(100, brightness))
     payload = bytes([0x3A, 0x02, 0x03, 0x01, brightness, temp_byte])
-    cmd = payload + usb_checksum(payload)
-    ser.reset_input_buffer()
-    ser.write(cmd)
-    ser.flush()
-    time.sleep(0.3)
-    ser.read(ser.in_waiting or 0)  # drain echo
+    send_command(ser, payload, timeout=0.3)
 
 
 def main():